@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include "config.hpp"
+
+using namespace std;
+
+/**
+ * EPIOCSPARAMS 는 linux 6.9+ 에서 추가됐어요. 헤더가 오래된 경우 직접 정의.
+ * @link https://docs.kernel.org/networking/napi.html#epoll-based-busy-polling
+ *
+ */
+#ifndef EPIOCSPARAMS
+struct epoll_params
+{
+  uint32_t busy_poll_usecs;
+  uint16_t busy_poll_budget;
+  uint8_t prefer_busy_poll;
+  uint8_t __pad;
+};
+
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW( EPOLL_IOC_TYPE, 0x01, struct epoll_params )
+#endif
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## BusyPoll
+   *
+   * worker 하나당 하나씩 들고 epoll_wait 대신 wait() 를 불러요.
+   *
+   * - spin_budget_us 동안 timeout 0 으로 epoll_wait 를 돌리다가 이벤트가 없으면 block
+   * - 연속으로 빈손이면 budget 을 절반씩 줄여서 (idle_backoff_loops 마다) 결국 그냥 잠들어요
+   * - 이벤트가 잡히면 budget 은 바로 원래대로 복구
+   *
+   */
+  class BusyPoll
+  {
+  private:
+    PerformanceBusyPoll m_config;
+
+    uint64_t m_budget_ns{ 0 };
+    uint32_t m_idle_loops{ 0 };
+
+    static uint64_t now_ns() noexcept
+    {
+      timespec ts{};
+      clock_gettime( CLOCK_MONOTONIC, &ts );
+
+      return static_cast<uint64_t>( ts.tv_sec ) * 1'000'000'000ULL + ts.tv_nsec;
+    }
+
+    uint64_t max_budget_ns() const noexcept
+    {
+      return static_cast<uint64_t>( m_config.spin_budget_us ) * 1000;
+    }
+
+  public:
+    explicit BusyPoll( const PerformanceBusyPoll& config ) : m_config( config ), m_budget_ns( max_budget_ns() ) {}
+
+    int wait( int epfd, epoll_event* events, int max_events, int timeout_ms ) noexcept
+    {
+      if ( !m_config.enabled || m_budget_ns == 0 )
+      {
+        int n = epoll_wait( epfd, events, max_events, timeout_ms );
+
+        // 자다가 깨어난 경우 다시 spin 모드로
+        if ( n > 0 && m_config.enabled )
+        {
+          m_budget_ns = max_budget_ns();
+          m_idle_loops = 0;
+        }
+
+        return n;
+      }
+
+      const uint64_t deadline = now_ns() + m_budget_ns;
+
+      do
+      {
+        int n = epoll_wait( epfd, events, max_events, 0 );
+
+        if ( n != 0 )
+        {
+          if ( n > 0 )
+          {
+            m_budget_ns = max_budget_ns();
+            m_idle_loops = 0;
+          }
+
+          return n;
+        }
+      } while ( now_ns() < deadline );
+
+      // ## ADAPTIVE BACK-OFF
+      if ( ++m_idle_loops >= m_config.idle_backoff_loops )
+      {
+        m_idle_loops = 0;
+        m_budget_ns >>= 1;
+
+        if ( m_budget_ns < 1000 ) // 1us 미만이면 의미없어요
+        {
+          m_budget_ns = 0;
+        }
+      }
+
+      return epoll_wait( epfd, events, max_events, timeout_ms );
+    }
+
+    uint64_t budget_ns() const noexcept
+    {
+      return m_budget_ns;
+    }
+
+    /**
+     * ---------------
+     * SOCKET / EPOLL OPTIONS
+     *
+     * 커널이 지원하지 않으면(EINVAL/ENOTTY/ENOPROTOOPT) 그냥 false, spin 만으로도 동작해요.
+     * SO_BUSY_POLL 은 CAP_NET_ADMIN 없이 net.core.busy_read 보다 크게 설정할 수 없어요.
+     * napi_budget 도 64 (NAPI_POLL_WEIGHT) 를 넘기면 CAP_NET_ADMIN 이 필요해요 (없으면 EPERM).
+     *
+     */
+    static constexpr uint16_t DEFAULT_NAPI_BUDGET = 8; // 커널 기본값 (BUSY_POLL_BUDGET)
+
+    static bool apply_socket( int fd, const PerformanceBusyPoll& config ) noexcept
+    {
+      if ( !config.enabled || config.socket_busy_poll_us == 0 )
+      {
+        return false;
+      }
+
+      bool is_ok = true;
+
+      int usecs = static_cast<int>( config.socket_busy_poll_us );
+      is_ok &= setsockopt( fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof( usecs ) ) == 0;
+
+      if ( config.is_prefer_busy_poll )
+      {
+        int one = 1;
+        is_ok &= setsockopt( fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof( one ) ) == 0;
+      }
+
+      if ( config.napi_budget > 0 )
+      {
+        int budget = static_cast<int>( config.napi_budget );
+        is_ok &= setsockopt( fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof( budget ) ) == 0;
+      }
+
+      return is_ok;
+    }
+
+    static bool apply_epoll( int epfd, const PerformanceBusyPoll& config ) noexcept
+    {
+      if ( !config.enabled || config.socket_busy_poll_us == 0 )
+      {
+        return false;
+      }
+
+      epoll_params params{};
+      params.busy_poll_usecs = config.socket_busy_poll_us;
+      // 0 을 그대로 넘기면 poll 할 때마다 패킷을 하나도 안 가져와서 busy-poll 이 꺼진 것과 같아요
+      params.busy_poll_budget = config.napi_budget > 0 ? static_cast<uint16_t>( config.napi_budget ) : DEFAULT_NAPI_BUDGET;
+      params.prefer_busy_poll = config.is_prefer_busy_poll ? 1 : 0;
+
+      return ioctl( epfd, EPIOCSPARAMS, &params ) == 0;
+    }
+  };
+
+} // namespace lite_passthrough_proxy
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include "config.hpp"
+
+using namespace std;
+
+// <linux/netfilter_ipv4.h> 는 <netinet/in.h> 와 충돌해서 직접 정의해요
+#ifndef SO_ORIGINAL_DST
+#define SO_ORIGINAL_DST 80
+#endif
+
+#ifndef IP6T_SO_ORIGINAL_DST
+#define IP6T_SO_ORIGINAL_DST 80
+#endif
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## Capture (TPROXY / SO_ORIGINAL_DST)
+   *
+   * `transparent: true` 인 route 는 포트마다 소켓을 열지 않고, worker 당 IP_TRANSPARENT TCP listener 1개 + UDP 소켓 1개로
+   * options.capture.port 하나에 port_range 전체를 받아요. 원래 목적지 포트로 route 를 찾아서 dest port 로 매핑.
+   *
+   * > iptables -t mangle -A PREROUTING -p tcp --dport 9000:9010 -j TPROXY --on-port 15000 --tproxy-mark 0x1/0x1
+   * > iptables -t mangle -A PREROUTING -p udp --dport 9000:9010 -j TPROXY --on-port 15000 --tproxy-mark 0x1/0x1
+   * > ip rule add fwmark 0x1 lookup 100 && ip route add local 0.0.0.0/0 dev lo table 100
+   *
+   * netns 안에서 loopback 만으로 테스트하려면 PREROUTING 대신 OUTPUT 에 MARK + 위 ip rule 을 걸면 돼요.
+   * CAP_NET_ADMIN 필요. REDIRECT(nat) 로 들어온 TCP 는 SO_ORIGINAL_DST 로 복구해요.
+   *
+   */
+  class Capture
+  {
+  private:
+    static bool set_transparent( int fd, int family ) noexcept
+    {
+      int one = 1;
+
+      if ( family == AF_INET6 )
+      {
+        return setsockopt( fd, SOL_IPV6, IPV6_TRANSPARENT, &one, sizeof( one ) ) == 0;
+      }
+
+      return setsockopt( fd, SOL_IP, IP_TRANSPARENT, &one, sizeof( one ) ) == 0;
+    }
+
+    static int open_socket( int family, int type, const sockaddr_storage& bind_addr ) noexcept
+    {
+      int fd = socket( family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+      if ( fd < 0 )
+      {
+        return -1;
+      }
+
+      int one = 1;
+      setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+      setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof( one ) );
+
+      socklen_t len = ( family == AF_INET ) ? sizeof( sockaddr_in ) : sizeof( sockaddr_in6 );
+      if ( !set_transparent( fd, family ) || bind( fd, reinterpret_cast<const sockaddr*>( &bind_addr ), len ) != 0 )
+      {
+        close( fd );
+        return -1;
+      }
+
+      return fd;
+    }
+
+    static sockaddr_storage any_address( int family, uint16_t port ) noexcept
+    {
+      sockaddr_storage addr{};
+
+      if ( family == AF_INET6 )
+      {
+        auto* sin6 = reinterpret_cast<sockaddr_in6*>( &addr );
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_addr = in6addr_any;
+        sin6->sin6_port = htons( port );
+      }
+      else
+      {
+        auto* sin = reinterpret_cast<sockaddr_in*>( &addr );
+        sin->sin_family = AF_INET;
+        sin->sin_addr.s_addr = htonl( INADDR_ANY );
+        sin->sin_port = htons( port );
+      }
+
+      return addr;
+    }
+
+  public:
+    /**
+     * ---------------
+     * SOCKETS (worker 마다 하나씩, SO_REUSEPORT)
+     *
+     */
+    static int open_tcp( int family, uint16_t port ) noexcept
+    {
+      int fd = open_socket( family, SOCK_STREAM, any_address( family, port ) );
+      if ( fd >= 0 && listen( fd, SOMAXCONN ) != 0 )
+      {
+        close( fd );
+        return -1;
+      }
+
+      return fd;
+    }
+
+    static int open_udp( int family, uint16_t port ) noexcept
+    {
+      int fd = open_socket( family, SOCK_DGRAM, any_address( family, port ) );
+      if ( fd < 0 )
+      {
+        return -1;
+      }
+
+      int one = 1;
+      bool is_ok = ( family == AF_INET6 ) ? setsockopt( fd, SOL_IPV6, IPV6_RECVORIGDSTADDR, &one, sizeof( one ) ) == 0 : setsockopt( fd, SOL_IP, IP_RECVORIGDSTADDR, &one, sizeof( one ) ) == 0;
+
+      if ( !is_ok )
+      {
+        close( fd );
+        return -1;
+      }
+
+      return fd;
+    }
+
+    /**
+     * UDP 응답은 client 가 보낸 원래 목적지 주소(origin)에서 나가야 해요.
+     * 세션마다 origin 에 bind 한 transparent 소켓을 하나씩 열고 client 로 connect 해요.
+     *
+     * connect 안 하면 TPROXY 가 같은 origin 으로 오는 datagram (다른 client 것까지) 을 이 소켓에 넣어버려요.
+     * connect 해도 이 client 의 다음 datagram 은 capture 소켓이 아니라 여기로 와요 (connected 소켓이 먼저 매칭).
+     * 그래서 응답 전용이 아니라 세션의 client 쪽 소켓이에요. epoll 에 같이 등록해서 읽은 건 upstream 으로 넘겨야 해요.
+     */
+    static int open_udp_reply( const sockaddr_storage& origin, const sockaddr_storage& client ) noexcept
+    {
+      int fd = open_socket( origin.ss_family, SOCK_DGRAM, origin );
+      if ( fd < 0 )
+      {
+        return -1;
+      }
+
+      socklen_t len = ( client.ss_family == AF_INET ) ? sizeof( sockaddr_in ) : sizeof( sockaddr_in6 );
+      if ( connect( fd, reinterpret_cast<const sockaddr*>( &client ), len ) != 0 )
+      {
+        close( fd );
+        return -1;
+      }
+
+      return fd;
+    }
+
+    /**
+     * ---------------
+     * ORIGINAL DESTINATION
+     *
+     */
+    static bool original_dst_tcp( int fd, sockaddr_storage& origin ) noexcept
+    {
+      socklen_t len = sizeof( origin );
+
+      // TPROXY: accept 된 소켓의 local 주소가 곧 원래 목적지
+      if ( getsockname( fd, reinterpret_cast<sockaddr*>( &origin ), &len ) != 0 )
+      {
+        return false;
+      }
+
+      // REDIRECT(nat): conntrack 에 물어봐요. TPROXY 면 ENOENT 라 getsockname 값 유지
+      sockaddr_storage nat{};
+      len = sizeof( nat );
+
+      const int level = ( origin.ss_family == AF_INET6 ) ? SOL_IPV6 : SOL_IP;
+      const int name = ( origin.ss_family == AF_INET6 ) ? IP6T_SO_ORIGINAL_DST : SO_ORIGINAL_DST;
+
+      if ( getsockopt( fd, level, name, &nat, &len ) == 0 )
+      {
+        origin = nat;
+      }
+
+      return true;
+    }
+
+    /**
+     * recvmsg / recvmmsg(BatchIO::get_msg) 의 control message 에서 원래 목적지를 꺼내요.
+     */
+    static bool original_dst_udp( const msghdr& msg, sockaddr_storage& origin ) noexcept
+    {
+      for ( auto* cmsg = CMSG_FIRSTHDR( const_cast<msghdr*>( &msg ) ); cmsg; cmsg = CMSG_NXTHDR( const_cast<msghdr*>( &msg ), cmsg ) )
+      {
+        if ( cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_ORIGDSTADDR )
+        {
+          memcpy( &origin, CMSG_DATA( cmsg ), sizeof( sockaddr_in ) );
+          return true;
+        }
+
+        if ( cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_ORIGDSTADDR )
+        {
+          memcpy( &origin, CMSG_DATA( cmsg ), sizeof( sockaddr_in6 ) );
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    static uint16_t port_of( const sockaddr_storage& addr ) noexcept
+    {
+      if ( addr.ss_family == AF_INET6 )
+      {
+        return ntohs( reinterpret_cast<const sockaddr_in6*>( &addr )->sin6_port );
+      }
+
+      return ntohs( reinterpret_cast<const sockaddr_in*>( &addr )->sin_port );
+    }
+  };
+
+  /**
+   * ## CaptureTable
+   *
+   * 원래 목적지 포트 -> route. 65536 칸짜리 index (128KB) 라서 연결/패킷마다 O(1).
+   * route 가 reload 되면 새로 만들어요.
+   *
+   */
+  class CaptureTable
+  {
+  private:
+    static constexpr uint16_t NONE = 0xFFFF;
+
+    array<uint16_t, 65536> m_index;
+    const vector<Route>* m_routes{ nullptr };
+
+  public:
+    CaptureTable( const vector<Route>& routes, const string& protocol ) : m_routes( &routes )
+    {
+      m_index.fill( NONE );
+
+      for ( size_t i = 0; i < routes.size() && i < NONE; ++i )
+      {
+        const auto& route = routes[i];
+        if ( !route.is_transparent || route.protocol != protocol )
+        {
+          continue;
+        }
+
+        for ( uint32_t port = route.src_port_from; port <= route.src_port_to; ++port )
+        {
+          m_index[port] = static_cast<uint16_t>( i );
+        }
+      }
+    }
+
+    const Route* find( uint16_t original_port ) const noexcept
+    {
+      const uint16_t i = m_index[original_port];
+      return i == NONE ? nullptr : &( *m_routes )[i];
+    }
+
+    /**
+     * src port_range 안의 offset 그대로 dest port_range 로 옮겨요. (9003 -> 8003)
+     */
+    static uint16_t dest_port( const Route& route, uint16_t original_port ) noexcept
+    {
+      return static_cast<uint16_t>( route.dest_port_from + ( original_port - route.src_port_from ) );
+    }
+  };
+
+} // namespace lite_passthrough_proxy
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <thread>
+#include "config.hpp"
+#include "timer_cycle.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## CoarseClock
+   *
+   * 패킷마다 steady_clock::now() 를 부르지 않고, 캐시해둔 monotonic ns 를 읽어요. (hot path 에선 load 하나)
+   *
+   * - worker: reactor loop 한바퀴마다 update() 한번 -> 그 loop 안에서는 now_ns() 가 thread_local 값
+   * - 그 외 thread: start( ..., ticker_us ) 로 ticker thread 를 켜두면 ticker_us 마다 갱신된 값
+   * - 둘 다 없으면 그냥 clock_gettime (느리지만 값은 맞아요). ticker 가 안 돌 때 s_ticker_ns 는 0 이라 멈춘 값을 돌려주지 않아요
+   * - is_coarse: CLOCK_MONOTONIC_COARSE 로 읽어요 (vDSO 에서 더 싸지만 해상도가 jiffy, 1~4ms)
+   *
+   * 정밀한 deadline(ReturnBatch flush 같은 us 단위)은 read_precise() 를 써요.
+   * performance.clock 은 load / reload 때마다 반영돼요 (바뀌었을 때만 start 다시). instance() 가 처음 불린 뒤부터라서 config load 전에 한번 불러두세요.
+   *
+   */
+  class CoarseClock
+  {
+  private:
+    static constexpr uint64_t NS_PER_TICK = TICK_DURATION_MS * 1'000'000ULL;
+
+    static inline atomic<clockid_t> s_clock_id{ CLOCK_MONOTONIC }; // reload 로 바뀌는 중에도 worker 가 읽어요
+    static inline thread_local uint64_t t_now_ns = 0;
+
+    alignas( 64 ) static inline atomic<uint64_t> s_ticker_ns{ 0 };
+    static inline atomic<int64_t> s_realtime_offset_ns{ 0 }; // realtime - monotonic
+    static inline atomic<uint64_t> s_realtime_synced_ns{ 0 }; // 마지막으로 맞춘 monotonic 시각
+
+    atomic<bool> m_is_running{ false };
+    thread m_ticker;
+
+    bool m_is_configured{ false };
+    PerformanceClock m_clock; // 마지막으로 반영한 값
+
+    static uint64_t read_clock( clockid_t id ) noexcept
+    {
+      timespec ts{};
+      clock_gettime( id, &ts );
+
+      return static_cast<uint64_t>( ts.tv_sec ) * 1'000'000'000ULL + ts.tv_nsec;
+    }
+
+    static constexpr uint64_t REALTIME_SYNC_NS = 1'000'000'000ULL; // NTP 로 realtime 이 움직일 수 있어서 1초마다 다시 맞춰요
+
+    static void sync_realtime() noexcept
+    {
+      const uint64_t mono = read_clock( CLOCK_MONOTONIC );
+      const uint64_t real = read_clock( CLOCK_REALTIME );
+
+      s_realtime_offset_ns.store( static_cast<int64_t>( real - mono ), memory_order_relaxed );
+      s_realtime_synced_ns.store( mono, memory_order_relaxed );
+    }
+
+    void run( uint32_t ticker_us )
+    {
+      const auto interval = chrono::microseconds( ticker_us );
+
+      while ( m_is_running.load( memory_order_relaxed ) )
+      {
+        s_ticker_ns.store( read(), memory_order_relaxed );
+        this_thread::sleep_for( interval );
+      }
+    }
+
+    void configure( const PerformanceClock& clock )
+    {
+      if ( m_is_configured && clock.is_coarse == m_clock.is_coarse && clock.ticker_us == m_clock.ticker_us )
+      {
+        return;
+      }
+
+      start( clock.is_coarse, clock.ticker_us );
+
+      m_clock = clock;
+      m_is_configured = true;
+    }
+
+    CoarseClock()
+    {
+      ConfigManager::instance().subscribe( [this]( const Config& config ) { configure( config.performance.clock ); } );
+    }
+
+  public:
+    static CoarseClock& instance()
+    {
+      static CoarseClock singleton;
+      return singleton;
+    }
+
+    CoarseClock( const CoarseClock& ) = delete;
+    CoarseClock& operator=( const CoarseClock& ) = delete;
+
+    ~CoarseClock()
+    {
+      stop();
+    }
+
+    /**
+     * 보통은 config listener 가 불러요. ticker_us == 0 이면 ticker thread 없이 worker loop 갱신만 써요.
+     */
+    void start( bool is_coarse, uint32_t ticker_us )
+    {
+      stop();
+
+      s_clock_id.store( is_coarse ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC, memory_order_relaxed );
+      sync_realtime();
+
+      // ticker 가 갱신하지 않는 s_ticker_ns 를 채워두면 now_ns() 가 그 값에 멈춰요
+      if ( ticker_us > 0 )
+      {
+        s_ticker_ns.store( read(), memory_order_relaxed );
+        m_is_running.store( true, memory_order_relaxed );
+        m_ticker = thread( &CoarseClock::run, this, ticker_us );
+      }
+    }
+
+    void stop()
+    {
+      m_is_running.store( false, memory_order_relaxed );
+
+      if ( m_ticker.joinable() )
+      {
+        m_ticker.join();
+      }
+
+      s_ticker_ns.store( 0, memory_order_relaxed );
+    }
+
+    /**
+     * ---------------
+     * READ (hot path)
+     *
+     */
+    static inline uint64_t read() noexcept
+    {
+      return read_clock( s_clock_id.load( memory_order_relaxed ) );
+    }
+
+    static inline uint64_t read_precise() noexcept
+    {
+      return read_clock( CLOCK_MONOTONIC );
+    }
+
+    /**
+     * reactor loop 맨 앞에서 한번 (epoll_wait 가 돌아온 직후)
+     */
+    static inline uint64_t update() noexcept
+    {
+      t_now_ns = read();
+      return t_now_ns;
+    }
+
+    static inline uint64_t now_ns() noexcept
+    {
+      if ( t_now_ns != 0 )
+      {
+        return t_now_ns;
+      }
+
+      const uint64_t ticker = s_ticker_ns.load( memory_order_relaxed );
+      return ticker != 0 ? ticker : read();
+    }
+
+    static inline uint64_t now_ms() noexcept
+    {
+      return now_ns() / 1'000'000ULL;
+    }
+
+    /**
+     * TimerCycle tick (TICK_DURATION_MS 단위). idle/session 만료는 이 값끼리 비교해요.
+     */
+    static inline uint64_t ticks() noexcept
+    {
+      return now_ns() / NS_PER_TICK;
+    }
+
+    static inline uint64_t ticks_after( uint64_t timeout_ms ) noexcept
+    {
+      return ticks() + ( timeout_ms + TICK_DURATION_MS - 1 ) / TICK_DURATION_MS;
+    }
+
+    /**
+     * flow journal 처럼 사람이 읽을 시각이 필요할 때 (CLOCK_REALTIME 기준 ns)
+     * offset 이 REALTIME_SYNC_NS 보다 오래됐으면 부른 thread 가 다시 맞춰요 (ticker 유무와 상관없이, 1초에 한번꼴)
+     */
+    static inline uint64_t realtime_ns() noexcept
+    {
+      const uint64_t now = now_ns();
+      const uint64_t synced = s_realtime_synced_ns.load( memory_order_relaxed );
+
+      // worker 의 now 는 loop 시작 때 값이라 다른 thread 가 방금 맞춘 synced 보다 작을 수 있어요. 그땐 아직 fresh
+      if ( synced == 0 || ( now > synced && now - synced >= REALTIME_SYNC_NS ) )
+      {
+        sync_realtime();
+      }
+
+      return static_cast<uint64_t>( static_cast<int64_t>( now ) + s_realtime_offset_ns.load( memory_order_relaxed ) );
+    }
+  };
+
+} // namespace lite_passthrough_proxy
@@ -2,8 +2,13 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
 #include <netdb.h>
 #include <optional>
 #include <regex>
@@ -11,6 +16,7 @@
 #include <variant>
 #include <vector>
 #include <yaml-cpp/yaml.h>
+#include "endpoint.hpp"
 
 using namespace std;
 
@@ -31,6 +37,27 @@ namespace lite_passthrough_proxy
   static const regex REGEXP_IPv6{ R"(^([0-9a-fA-F]{1,4}:){7}[0-9a-fA-F]{1,4}$|^::1$|^::$|^([0-9a-fA-F]{1,4}:)*::([0-9a-fA-F]{1,4}:)*[0-9a-fA-F]{1,4}$)" };
   static const regex REGEXP_DOMAIN{ R"(^[a-zA-Z0-9]([a-zA-Z0-9\-]{0,61}[a-zA-Z0-9])?(\.[a-zA-Z0-9]([a-zA-Z0-9\-]{0,61}[a-zA-Z0-9])?)*$)" };
 
+  /**
+   * ## SocketProfile
+   *
+   * route 별 소켓 튜닝. 0 / 빈값 / -1 은 "건드리지 않음" (buffer 는 kernel_socket 전역값을 써요)
+   *
+   * - is_nodelay, notsent_lowat, congestion: TCP 전용
+   * - dscp: IP_TOS / IPV6_TCLASS 의 상위 6bit (0 ~ 63, 예: EF = 46)
+   */
+  struct SocketProfile
+  {
+    string name{ "" };
+
+    size_t recv_buffer_size{ 0 };
+    size_t send_buffer_size{ 0 };
+
+    bool is_nodelay{ false };
+    uint32_t notsent_lowat{ 0 };
+    string congestion{ "" };
+    int dscp{ -1 };
+  };
+
   /**
    * ## Route
    *
@@ -48,9 +75,13 @@ namespace lite_passthrough_proxy
 
     bool is_single_port{ false }; // 단일 포트인지 범위인지 구분
     bool is_preserve_ip{ false }; // preserve, forwarding origin client IP
+    bool is_transparent{ false }; // TPROXY capture, options.capture.port 하나로 port_range 전체를 받아요
     bool is_correct{ false };     // FLAG - correct route
 
-    vector<sockaddr_storage> resolved_addrs;
+    string socket_profile{ "" }; // performance.socket_profiles[].name
+    SocketProfile socket_tuning; // load 시점에 profile + kernel_socket 을 합쳐서 채워요
+
+    vector<Endpoint> resolved_addrs; // connect() 할 때 to_sockaddr()
   };
 
   /**
@@ -61,15 +92,49 @@ namespace lite_passthrough_proxy
   {
     uint32_t idle_timeout{ 60000 };
     uint32_t connect_timeout{ 10000 };
+    uint32_t connect_attempt_delay{ 250 }; // resolved 주소가 여러개면 이 간격으로 다음 주소에 동시 connect (RFC 8305)
     uint32_t shutdown_timeout{ 30000 };
   };
 
+  /**
+   * - socket_path: 새 프로세스가 fd 를 받아갈 unix socket (빈값: 비활성화)
+   * - is_handoff_connections: listener 뿐 아니라 맺어진 TCP pair / UDP session 까지 넘김
+   */
+  struct OptionUpgrade
+  {
+    string socket_path{ "" };
+    bool is_handoff_connections{ false };
+  };
+
+  /**
+   * transparent route 를 받을 TPROXY --on-port (0: 비활성화)
+   */
+  struct OptionCapture
+  {
+    uint16_t port{ 0 };
+  };
+
+  /**
+   * 연결/세션 종료 시 record 1개씩 쌓는 mmap journal (flow_journal.hpp)
+   * - path: 빈값이면 비활성화, 실제 파일은 <path>.<seq>
+   * - segment_records: segment 하나에 들어갈 record 수 (128 bytes 씩), 꽉 차면 다음 segment
+   */
+  struct OptionFlowJournal
+  {
+    string path{ "" };
+    uint64_t segment_records{ 1048576 };
+  };
+
   struct Options
   {
     OptionConnection connection;
+    OptionUpgrade upgrade;
+    OptionCapture capture;
+    OptionFlowJournal flow_journal;
 
     uint32_t worker_threads{ 0 }; // Worker threads (0 = 힘닿는데까지쥐어짜용 💦)
     string log_level{ "error" };
+    string log_path{ "" }; // 빈값: stderr
     // uint16_t metrics_port{ 0 }; // metric port (Grafana) (0: 비활성화)
   };
 
@@ -109,10 +174,126 @@ namespace lite_passthrough_proxy
     size_t send_buffer_size{ 0 };
   };
 
+  /**
+   * busy-poll 은 지연시간 단위가 작아서 여기만 microseconds 를 써요.
+   *
+   * - spin_budget_us: worker 가 block 하기 전에 epoll_wait(0) 로 spin 하는 시간
+   * - idle_backoff_loops: 연속으로 빈손인 loop 가 이만큼 쌓이면 budget 을 절반으로
+   * - socket_busy_poll_us / is_prefer_busy_poll / napi_budget: SO_BUSY_POLL, SO_PREFER_BUSY_POLL, EPIOCSPARAMS
+   */
+  struct PerformanceBusyPoll
+  {
+    bool enabled{ false };
+    uint32_t spin_budget_us{ 50 };
+    uint32_t idle_backoff_loops{ 64 };
+    uint32_t socket_busy_poll_us{ 0 };
+    bool is_prefer_busy_poll{ false };
+    uint32_t napi_budget{ 0 };
+  };
+
+  /**
+   * splice pipe 크기 (연결 x 방향 마다 하나)
+   *
+   * - min_size: 시작/최소 크기, page 단위로 올림
+   * - max_size: bulk 흐름이 커질 수 있는 최대 (send_buffer_size, fs.pipe-max-size 를 넘지 않아요)
+   * - memory_limits: 전체 pipe 메모리 한도 (0 = 무제한)
+   */
+  struct PerformancePipe
+  {
+    size_t min_size{ 4096 };
+    size_t max_size{ 1048576 };
+    size_t memory_limits{ 268435456 };
+  };
+
+  /**
+   * 전체 메모리 budget (0 = 무제한). percent 는 limits 기준
+   *
+   * - soft_percent 이상: 새 연결/세션 거절, pipe 확장 금지, 새 소켓 buffer 축소
+   * - hard_percent 이상: 기존 splice 흐름도 pipe 를 비우고 copy relay 로 내려가요
+   * - oom_score_adj: /proc/self/oom_score_adj (-1000 ~ 1000, 0 = 건드리지 않음). 음수는 CAP_SYS_RESOURCE 필요.
+   *   budget 은 추정치라 머신 전체가 모자라면 OOM killer 가 올 수 있어요. 음수로 두면 다른 process 가 먼저 골라져요 (-1000 은 아예 제외라 비추천)
+   */
+  struct PerformanceMemory
+  {
+    size_t limits{ 0 };
+    uint32_t soft_percent{ 80 };
+    uint32_t hard_percent{ 95 };
+    int32_t oom_score_adj{ 0 };
+  };
+
+  /**
+   * - enabled: worker 를 NIC 쪽 node CPU 부터 배정하고 worker 메모리를 local node 에 둬요
+   * - nic: NIC 이름 (/sys/class/net/<nic>/device/numa_node), 빈값이면 node 0
+   */
+  struct PerformanceNuma
+  {
+    bool enabled{ false };
+    string nic{ "" };
+  };
+
+  /**
+   * hot path 에서 쓰는 캐시된 clock (coarse_clock.hpp)
+   *
+   * - is_coarse: CLOCK_MONOTONIC_COARSE 사용 (더 싸지만 해상도 1~4ms)
+   * - ticker_us: worker 밖 thread 용 ticker 갱신 주기 (0 = ticker 없이 worker loop 갱신만)
+   */
+  struct PerformanceClock
+  {
+    bool is_coarse{ false };
+    uint32_t ticker_us{ 0 };
+  };
+
+  /**
+   * 오래 가는 TCP 흐름을 바쁜 worker 에서 한가한 worker 로 옮겨요 (rebalance.hpp)
+   *
+   * - high_water_percent: worker loop busy 비율이 이 이상이면 넘길 후보
+   * - low_water_percent: 받는 worker 는 이 이하여야 해요
+   * - interval_ms / max_per_interval: worker 하나가 interval 동안 넘길 수 있는 최대 연결 수
+   */
+  struct PerformanceRebalance
+  {
+    bool enabled{ false };
+    uint32_t high_water_percent{ 85 };
+    uint32_t low_water_percent{ 50 };
+    uint32_t interval_ms{ 1000 };
+    uint32_t max_per_interval{ 8 };
+  };
+
+  /**
+   * COPY 경로(splice 못 쓰는 작은/중간 TCP 흐름)의 큰 send 를 MSG_ZEROCOPY 로
+   * - min_size: 이 크기 이상의 send 만 (그 아래는 page pinning + 완료 알림 비용이 복사보다 커요)
+   */
+  struct PerformanceZeroCopy
+  {
+    bool enabled{ false };
+    size_t min_size{ 10240 };
+  };
+
+  /**
+   * UDP 패킷이 proxy 안에서 머문 시간 (커널 수신 SO_TIMESTAMPING -> 우리가 send) 을 route 별 histogram 으로
+   * - client -> upstream (BatchIO::send_batch), upstream -> client (ReturnBatch::flush) 를 따로 재요 (RouteLatency::Leg). TCP 는 안 재요
+   * - 패킷마다 cmsg 파싱 + clock_gettime 이 붙어서 측정할 때만 켜요
+   */
+  struct PerformanceTimestamping
+  {
+    bool enabled{ false };
+  };
+
   struct Performance
   {
     vector<int> cpu_affinity;
+    PerformanceClock clock;
+    PerformanceRebalance rebalance;
+    PerformanceNuma numa;
+    PerformanceBusyPoll busy_poll;
     PerformanceKernelSocket kernel_socket;
+    PerformancePipe pipe;
+    PerformanceZeroCopy zerocopy;
+    PerformanceTimestamping timestamping;
+    PerformanceMemory memory;
+    vector<SocketProfile> socket_profiles;
+    uint32_t udp_flush_deadline_us{ 200 }; // UDP 응답 batch(sendmmsg) 를 붙잡아둘 수 있는 최대 시간
+    string udp_steering{ "client" };       // reuseport BPF: off, client (client IP hash), cpu (받은 CPU)
   };
 
   /**
@@ -134,6 +315,9 @@ namespace lite_passthrough_proxy
     atomic<shared_ptr<Config>> m_current{ make_shared<Config>() };
     atomic<uint64_t> m_version{ 0 };
 
+    mutex m_listeners_mutex;
+    vector<function<void( const Config& )>> m_listeners;
+
     template <typename T> void yaml_bind( T& target, const YAML::Node& node, const optional<T>& default_value = nullopt )
     {
       if ( node && !node.IsNull() )
@@ -196,6 +380,117 @@ namespace lite_passthrough_proxy
       return port > 0 && port <= 65535;
     }
 
+    static size_t read_proc_size( const char* path, size_t fallback )
+    {
+      size_t value = fallback;
+      ifstream( path ) >> value;
+
+      return value;
+    }
+
+    static bool is_listed( const char* path, const string& name )
+    {
+      ifstream list( path );
+      string algorithm;
+
+      while ( list >> algorithm )
+      {
+        if ( algorithm == name )
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    static bool has_net_admin()
+    {
+      ifstream status( "/proc/self/status" );
+      string line;
+
+      while ( getline( status, line ) )
+      {
+        if ( line.rfind( "CapEff:", 0 ) == 0 )
+        {
+          return ( strtoull( line.c_str() + 7, nullptr, 16 ) >> 12 ) & 1; // CAP_NET_ADMIN = 12
+        }
+      }
+
+      return false;
+    }
+
+    /**
+     * 아무 process 나 쓸 수 있는 건 tcp_allowed_congestion_control, CAP_NET_ADMIN 이 있으면 로드된 것 (tcp_available_congestion_control) 전부
+     */
+    static bool is_allowed_congestion( const string& name )
+    {
+      if ( is_listed( "/proc/sys/net/ipv4/tcp_allowed_congestion_control", name ) )
+      {
+        return true;
+      }
+
+      return is_listed( "/proc/sys/net/ipv4/tcp_available_congestion_control", name ) && has_net_admin();
+    }
+
+    /**
+     * route 가 참조하는 profile 을 찾아서 socket_tuning 을 채우고 /proc/sys/net 한도로 검증해요.
+     *
+     * - 없는 profile, 범위 밖 dscp: load 실패
+     * - 못 쓰는 congestion: route 가 참조하는 profile 이면 load 실패, 아무도 안 쓰는 profile 이면 상관없어요
+     * - buffer 가 rmem_max / wmem_max 보다 크면 커널이 어차피 잘라내니까 그 값으로 맞춰요
+     */
+    bool resolve_socket_profiles( Config& cfg )
+    {
+      const size_t rmem_max = read_proc_size( "/proc/sys/net/core/rmem_max", SIZE_MAX );
+      const size_t wmem_max = read_proc_size( "/proc/sys/net/core/wmem_max", SIZE_MAX );
+
+      for ( auto& profile : cfg.performance.socket_profiles )
+      {
+        if ( is_empty( profile.name ) || profile.dscp > 63 || profile.dscp < -1 )
+        {
+          return false;
+        }
+
+        profile.recv_buffer_size = min( profile.recv_buffer_size, rmem_max );
+        profile.send_buffer_size = min( profile.send_buffer_size, wmem_max );
+      }
+
+      for ( auto& route : cfg.routes )
+      {
+        route.socket_tuning = SocketProfile{};
+
+        if ( !is_empty( route.socket_profile ) )
+        {
+          auto it = find_if( cfg.performance.socket_profiles.begin(), cfg.performance.socket_profiles.end(), [&]( const auto& o ) { return o.name == route.socket_profile; } );
+          if ( it == cfg.performance.socket_profiles.end() )
+          {
+            return false;
+          }
+
+          if ( !is_empty( it->congestion ) && !is_allowed_congestion( it->congestion ) )
+          {
+            return false;
+          }
+
+          route.socket_tuning = *it;
+        }
+
+        auto& tuning = route.socket_tuning;
+        if ( tuning.recv_buffer_size == 0 )
+        {
+          tuning.recv_buffer_size = min( cfg.performance.kernel_socket.recv_buffer_size, rmem_max );
+        }
+
+        if ( tuning.send_buffer_size == 0 )
+        {
+          tuning.send_buffer_size = min( cfg.performance.kernel_socket.send_buffer_size, wmem_max );
+        }
+      }
+
+      return true;
+    }
+
     void resolve_routes( Config& cfg )
     {
       for ( auto& route : cfg.routes )
@@ -212,15 +507,22 @@ namespace lite_passthrough_proxy
 
           for ( auto* rp = result; rp; rp = rp->ai_next )
           {
-            sockaddr_storage addr{};
-
-            memcpy( &addr, rp->ai_addr, rp->ai_addrlen );
-            route.resolved_addrs.push_back( addr );
+            route.resolved_addrs.push_back( Endpoint::from( rp->ai_addr ) );
           }
         }
       }
     }
 
+    void notify( const Config& config )
+    {
+      lock_guard<mutex> lock( m_listeners_mutex );
+
+      for ( const auto& listener : m_listeners )
+      {
+        listener( config );
+      }
+    }
+
   public:
     static ConfigManager& instance()
     {
@@ -272,6 +574,8 @@ namespace lite_passthrough_proxy
               route.protocol = "tcp";
             }
 
+            str_to_lower( route.protocol );
+
             // ## ROUTE DESTINATION
             if ( o["dest_host"] )
             {
@@ -323,6 +627,16 @@ namespace lite_passthrough_proxy
               yaml_bind<bool>( route.is_preserve_ip, o["preserve_ip"], false );
             }
 
+            if ( o["transparent"] )
+            {
+              yaml_bind<bool>( route.is_transparent, o["transparent"], false );
+            }
+
+            if ( o["socket_profile"] )
+            {
+              yaml_bind<string>( route.socket_profile, o["socket_profile"], "" );
+            }
+
             // ## ROUTE VALIDATION
             uint16_t src_port_len = route.src_port_to - route.src_port_from;
             uint16_t dest_port_len = route.dest_port_to - route.dest_port_from;
@@ -370,6 +684,8 @@ namespace lite_passthrough_proxy
 
           yaml_bind<uint32_t>( config->options.worker_threads, options["worker_threads"], 0 );
           yaml_bind<string>( config->options.log_level, options["log_level"], "error" );
+          yaml_bind<string>( config->options.log_path, options["log_path"], "" );
+          str_to_lower( config->options.log_level );
 
           if ( options["connection"] )
           {
@@ -377,8 +693,38 @@ namespace lite_passthrough_proxy
 
             yaml_bind<uint32_t>( config->options.connection.idle_timeout, connection["idle_timeout"], 60000 );
             yaml_bind<uint32_t>( config->options.connection.connect_timeout, connection["connect_timeout"], 10000 );
+            yaml_bind<uint32_t>( config->options.connection.connect_attempt_delay, connection["connect_attempt_delay"], 250 );
+
+            // RFC 8305 5. 10ms 미만은 금지, 2초 넘으면 의미가 없어요
+            config->options.connection.connect_attempt_delay = clamp<uint32_t>( config->options.connection.connect_attempt_delay, 10, 2000 );
             yaml_bind<uint32_t>( config->options.connection.shutdown_timeout, connection["shutdown_timeout"], 30000 );
           }
+
+          if ( options["capture"] )
+          {
+            yaml_bind<uint16_t>( config->options.capture.port, options["capture"]["port"], 0 );
+          }
+
+          if ( options["upgrade"] )
+          {
+            auto upgrade = options["upgrade"];
+
+            yaml_bind<string>( config->options.upgrade.socket_path, upgrade["socket_path"], "" );
+            yaml_bind<bool>( config->options.upgrade.is_handoff_connections, upgrade["handoff_connections"], false );
+          }
+
+          if ( options["flow_journal"] )
+          {
+            auto flow_journal = options["flow_journal"];
+
+            yaml_bind<string>( config->options.flow_journal.path, flow_journal["path"], "" );
+            yaml_bind<uint64_t>( config->options.flow_journal.segment_records, flow_journal["segment_records"], 1048576 );
+
+            if ( !config->options.flow_journal.path.empty() && config->options.flow_journal.segment_records == 0 )
+            {
+              return false;
+            }
+          }
         }
 
         if ( yaml["security"] )
@@ -420,6 +766,69 @@ namespace lite_passthrough_proxy
             }
           }
 
+          yaml_bind<uint32_t>( config->performance.udp_flush_deadline_us, performance["udp_flush_deadline_us"], 200 );
+          yaml_bind<string>( config->performance.udp_steering, performance["udp_steering"], "client" );
+
+          str_to_lower( config->performance.udp_steering );
+
+          if ( !compare( config->performance.udp_steering, "off" ) && !compare( config->performance.udp_steering, "client" ) && !compare( config->performance.udp_steering, "cpu" ) )
+          {
+            return false;
+          }
+
+          if ( performance["clock"] )
+          {
+            yaml_bind<bool>( config->performance.clock.is_coarse, performance["clock"]["coarse"], false );
+            yaml_bind<uint32_t>( config->performance.clock.ticker_us, performance["clock"]["ticker_us"], 0 );
+          }
+
+          if ( performance["rebalance"] )
+          {
+            auto rebalance = performance["rebalance"];
+
+            yaml_bind<bool>( config->performance.rebalance.enabled, rebalance["enabled"], false );
+            yaml_bind<uint32_t>( config->performance.rebalance.high_water_percent, rebalance["high_water_percent"], 85 );
+            yaml_bind<uint32_t>( config->performance.rebalance.low_water_percent, rebalance["low_water_percent"], 50 );
+            yaml_bind<uint32_t>( config->performance.rebalance.interval_ms, rebalance["interval_ms"], 1000 );
+            yaml_bind<uint32_t>( config->performance.rebalance.max_per_interval, rebalance["max_per_interval"], 8 );
+
+            if ( config->performance.rebalance.low_water_percent >= config->performance.rebalance.high_water_percent || config->performance.rebalance.high_water_percent > 100 )
+            {
+              return false;
+            }
+          }
+
+          if ( performance["zerocopy"] )
+          {
+            yaml_bind<bool>( config->performance.zerocopy.enabled, performance["zerocopy"]["enabled"], false );
+            yaml_bind<size_t>( config->performance.zerocopy.min_size, performance["zerocopy"]["min_size"], 10240 );
+          }
+
+          if ( performance["timestamping"] )
+          {
+            yaml_bind<bool>( config->performance.timestamping.enabled, performance["timestamping"]["enabled"], false );
+          }
+
+          if ( performance["busy_poll"] )
+          {
+            auto busy_poll = performance["busy_poll"];
+
+            yaml_bind<bool>( config->performance.busy_poll.enabled, busy_poll["enabled"], false );
+            yaml_bind<uint32_t>( config->performance.busy_poll.spin_budget_us, busy_poll["spin_budget_us"], 50 );
+            yaml_bind<uint32_t>( config->performance.busy_poll.idle_backoff_loops, busy_poll["idle_backoff_loops"], 64 );
+            yaml_bind<uint32_t>( config->performance.busy_poll.socket_busy_poll_us, busy_poll["socket_busy_poll_us"], 0 );
+            yaml_bind<bool>( config->performance.busy_poll.is_prefer_busy_poll, busy_poll["prefer_busy_poll"], false );
+            yaml_bind<uint32_t>( config->performance.busy_poll.napi_budget, busy_poll["napi_budget"], 0 );
+
+            // EPIOCSPARAMS 의 busy_poll_budget 은 uint16 이라 넘으면 잘려요 (70000 -> 4464)
+            config->performance.busy_poll.napi_budget = min<uint32_t>( config->performance.busy_poll.napi_budget, UINT16_MAX );
+
+            if ( config->performance.busy_poll.idle_backoff_loops == 0 )
+            {
+              config->performance.busy_poll.idle_backoff_loops = 1;
+            }
+          }
+
           if ( performance["kernel_socket"] )
           {
             auto kernel_socket = performance["kernel_socket"];
@@ -427,6 +836,60 @@ namespace lite_passthrough_proxy
             yaml_bind<size_t>( config->performance.kernel_socket.recv_buffer_size, kernel_socket["recv_buffer_size"], 0 );
             yaml_bind<size_t>( config->performance.kernel_socket.send_buffer_size, kernel_socket["send_buffer_size"], 0 );
           }
+
+          if ( performance["numa"] )
+          {
+            auto numa = performance["numa"];
+
+            yaml_bind<bool>( config->performance.numa.enabled, numa["enabled"], false );
+            yaml_bind<string>( config->performance.numa.nic, numa["nic"], "" );
+          }
+
+          if ( performance["memory"] )
+          {
+            auto memory = performance["memory"];
+
+            yaml_bind<size_t>( config->performance.memory.limits, memory["limits"], 0 );
+            yaml_bind<uint32_t>( config->performance.memory.soft_percent, memory["soft_percent"], 80 );
+            yaml_bind<uint32_t>( config->performance.memory.hard_percent, memory["hard_percent"], 95 );
+            yaml_bind<int32_t>( config->performance.memory.oom_score_adj, memory["oom_score_adj"], 0 );
+
+            config->performance.memory.hard_percent = min<uint32_t>( config->performance.memory.hard_percent, 100 );
+            config->performance.memory.soft_percent = min( config->performance.memory.soft_percent, config->performance.memory.hard_percent );
+            config->performance.memory.oom_score_adj = clamp<int32_t>( config->performance.memory.oom_score_adj, -1000, 1000 );
+          }
+
+          if ( performance["socket_profiles"] )
+          {
+            for ( const auto& o : performance["socket_profiles"] )
+            {
+              SocketProfile profile;
+
+              yaml_bind<string>( profile.name, o["name"], "" );
+              yaml_bind<size_t>( profile.recv_buffer_size, o["recv_buffer_size"], 0 );
+              yaml_bind<size_t>( profile.send_buffer_size, o["send_buffer_size"], 0 );
+              yaml_bind<bool>( profile.is_nodelay, o["nodelay"], false );
+              yaml_bind<uint32_t>( profile.notsent_lowat, o["notsent_lowat"], 0 );
+              yaml_bind<string>( profile.congestion, o["congestion"], "" );
+              yaml_bind<int>( profile.dscp, o["dscp"], -1 );
+
+              config->performance.socket_profiles.push_back( move( profile ) );
+            }
+          }
+
+          if ( performance["pipe"] )
+          {
+            auto pipe = performance["pipe"];
+
+            yaml_bind<size_t>( config->performance.pipe.min_size, pipe["min_size"], 4096 );
+            yaml_bind<size_t>( config->performance.pipe.max_size, pipe["max_size"], 1048576 );
+            yaml_bind<size_t>( config->performance.pipe.memory_limits, pipe["memory_limits"], 268435456 );
+
+            if ( config->performance.pipe.max_size < config->performance.pipe.min_size )
+            {
+              swap( config->performance.pipe.min_size, config->performance.pipe.max_size );
+            }
+          }
         }
 
         // 모든 route가 유효한지 검증
@@ -445,12 +908,28 @@ namespace lite_passthrough_proxy
           return false;
         }
 
+        // transparent route 는 capture.port 가 있어야 받을 수 있어요
+        for ( const auto& route : config->routes )
+        {
+          if ( route.is_transparent && config->options.capture.port == 0 )
+          {
+            return false;
+          }
+        }
+
+        if ( !resolve_socket_profiles( *config ) )
+        {
+          return false;
+        }
+
         resolve_routes( *config );
 
         auto old_version = m_version.load();
         m_current.store( config );
         m_version.store( old_version + 1 );
 
+        notify( *config );
+
         return true;
       } catch ( const exception& )
       {
@@ -463,6 +942,23 @@ namespace lite_passthrough_proxy
       return m_current.load();
     }
 
+    /**
+     * load() 가 성공할 때마다 (처음 + reload) 새 Config 로 불러요. 이미 load 된 뒤에 등록하면 바로 한번.
+     * 프로세스 전역 singleton (MemoryBudget, PipeGovernor, Logger ...) 이 설정을 받아가는 곳이에요.
+     * listener 는 load() 를 부른 thread 에서 돌아서 worker 와 동시에 돌 수 있어요 (atomic 으로만 바꾸세요)
+     */
+    void subscribe( function<void( const Config& )> listener )
+    {
+      lock_guard<mutex> lock( m_listeners_mutex );
+
+      if ( m_version.load() > 0 )
+      {
+        listener( *m_current.load() );
+      }
+
+      m_listeners.push_back( move( listener ) );
+    }
+
     uint64_t version() const
     {
       return m_version.load();
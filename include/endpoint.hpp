@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <bit>
+#include <compare>
+#include <cstdint>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## Endpoint
+   *
+   * sockaddr_storage(128 bytes) 대신 hot path 에서 들고다니는 20 bytes 주소 + 포트.
+   * IPv4 도 v4-mapped(::ffff:a.b.c.d) 로 넣어서 hash / 비교 / prefix mask 에 family 분기가 없어요.
+   *
+   * - addr: network byte order (sin6_addr 그대로), port: host order
+   * - sockaddr 변환은 syscall 경계(recvmmsg/sendmmsg/connect)에서만 from() / to_sockaddr()
+   * - from() 은 AF_INET6 의 v4-mapped 주소를 AF_INET 으로 맞춰요. to_sockaddr() 는 sockaddr_in 을 주는데, dual-stack UDP 소켓의 sendmsg 도 받아줘요
+   *
+   */
+  struct Endpoint
+  {
+    uint32_t addr[4]{};
+    uint16_t port{ 0 };
+    uint16_t family{ AF_UNSPEC };
+
+    static constexpr uint32_t V4_MAPPED_PREFIX = 0x0000FFFF; // host order, addr[2]
+
+    /**
+     * ---------------
+     * HELPERS
+     *
+     */
+    static constexpr uint32_t to_network( uint32_t host ) noexcept
+    {
+      if constexpr ( endian::native == endian::little )
+      {
+        return __builtin_bswap32( host );
+      }
+
+      return host;
+    }
+
+    static constexpr Endpoint v4( uint32_t host_ip, uint16_t port ) noexcept
+    {
+      Endpoint out;
+      out.addr[2] = to_network( V4_MAPPED_PREFIX );
+      out.addr[3] = to_network( host_ip );
+      out.port = port;
+      out.family = AF_INET;
+
+      return out;
+    }
+
+    constexpr bool is_v4() const noexcept
+    {
+      return family == AF_INET;
+    }
+
+    // host order
+    constexpr uint32_t ipv4() const noexcept
+    {
+      return to_network( addr[3] );
+    }
+
+    constexpr bool is_v4_mapped() const noexcept
+    {
+      return addr[0] == 0 && addr[1] == 0 && addr[2] == to_network( V4_MAPPED_PREFIX );
+    }
+
+    const uint8_t* bytes() const noexcept
+    {
+      return reinterpret_cast<const uint8_t*>( addr );
+    }
+
+    /**
+     * ---------------
+     * HASH / COMPARE / MASK
+     *
+     */
+    constexpr uint32_t hash() const noexcept
+    {
+      uint32_t h = addr[0] ^ addr[1] ^ addr[2] ^ addr[3] ^ ( static_cast<uint32_t>( port ) << 16 | family );
+
+      h ^= h >> 16;
+      h *= 0x85ebca6b;
+      h ^= h >> 13;
+      h *= 0xc2b2ae35;
+      h ^= h >> 16;
+
+      return h;
+    }
+
+    // port 는 빼고 주소만 (per-IP limiter)
+    constexpr uint32_t address_hash() const noexcept
+    {
+      Endpoint ip = *this;
+      ip.port = 0;
+
+      return ip.hash();
+    }
+
+    constexpr bool operator==( const Endpoint& ) const noexcept = default;
+    constexpr auto operator<=>( const Endpoint& ) const noexcept = default;
+
+    constexpr bool same_address( const Endpoint& other ) const noexcept
+    {
+      return addr[0] == other.addr[0] && addr[1] == other.addr[1] && addr[2] == other.addr[2] && addr[3] == other.addr[3];
+    }
+
+    /**
+     * prefix 는 family 기준 (IPv4 /24 = 24, IPv6 /64 = 64). port 는 0 으로
+     */
+    constexpr Endpoint masked( uint8_t prefix ) const noexcept
+    {
+      uint32_t bits = is_v4() ? 96u + min<uint32_t>( prefix, 32 ) : min<uint32_t>( prefix, 128 );
+
+      Endpoint out = *this;
+      out.port = 0;
+
+      for ( auto& word : out.addr )
+      {
+        const uint32_t keep = min<uint32_t>( bits, 32 );
+        const uint32_t mask = keep == 0 ? 0 : ( keep == 32 ? 0xFFFFFFFF : ~( 0xFFFFFFFFu >> keep ) );
+
+        word &= to_network( mask );
+        bits -= keep;
+      }
+
+      return out;
+    }
+
+    constexpr bool in_prefix( const Endpoint& network, uint8_t prefix ) const noexcept
+    {
+      return family == network.family && masked( prefix ).same_address( network.masked( prefix ) );
+    }
+
+    /**
+     * ---------------
+     * SOCKADDR (syscall 경계)
+     *
+     */
+    static Endpoint from( const sockaddr* sa ) noexcept
+    {
+      Endpoint out;
+
+      if ( sa->sa_family == AF_INET )
+      {
+        auto* sin = reinterpret_cast<const sockaddr_in*>( sa );
+        out.addr[2] = to_network( V4_MAPPED_PREFIX );
+        out.addr[3] = sin->sin_addr.s_addr;
+        out.port = ntohs( sin->sin_port );
+        out.family = AF_INET;
+      }
+      else if ( sa->sa_family == AF_INET6 )
+      {
+        auto* sin6 = reinterpret_cast<const sockaddr_in6*>( sa );
+        memcpy( out.addr, &sin6->sin6_addr, sizeof( out.addr ) );
+        out.port = ntohs( sin6->sin6_port );
+        // dual-stack 소켓으로 들어온 IPv4 (::ffff:a.b.c.d) 도 AF_INET 으로. 안 그러면 같은 client 가 hash / 비교 / prefix 에서 다른 주소가 돼요
+        out.family = out.is_v4_mapped() ? AF_INET : AF_INET6;
+      }
+
+      return out;
+    }
+
+    template <typename SockAddr> static Endpoint from( const SockAddr& sa ) noexcept
+    {
+      return from( reinterpret_cast<const sockaddr*>( &sa ) );
+    }
+
+    /**
+     * sockaddr_in6 크기면 IPv4/IPv6 둘 다 들어가요 (sockaddr_storage 필요없음). 반환값은 namelen
+     */
+    socklen_t to_sockaddr( sockaddr_in6& out ) const noexcept
+    {
+      memset( &out, 0, sizeof( out ) );
+
+      if ( is_v4() )
+      {
+        auto* sin = reinterpret_cast<sockaddr_in*>( &out );
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons( port );
+        sin->sin_addr.s_addr = addr[3];
+
+        return sizeof( sockaddr_in );
+      }
+
+      out.sin6_family = AF_INET6;
+      out.sin6_port = htons( port );
+      memcpy( &out.sin6_addr, addr, sizeof( addr ) );
+
+      return sizeof( sockaddr_in6 );
+    }
+
+    socklen_t to_sockaddr( sockaddr_storage& out ) const noexcept
+    {
+      return to_sockaddr( *reinterpret_cast<sockaddr_in6*>( &out ) );
+    }
+
+    string to_string() const
+    {
+      char buf[INET6_ADDRSTRLEN] = "-";
+
+      if ( is_v4() )
+      {
+        inet_ntop( AF_INET, &addr[3], buf, sizeof( buf ) );
+        return string( buf ) + ":" + std::to_string( port );
+      }
+
+      if ( family == AF_INET6 )
+      {
+        inet_ntop( AF_INET6, addr, buf, sizeof( buf ) );
+      }
+
+      return "[" + string( buf ) + "]:" + std::to_string( port );
+    }
+  };
+
+  static_assert( sizeof( Endpoint ) == 20, "Endpoint must be 20 bytes" );
+
+  struct EndpointHash
+  {
+    size_t operator()( const Endpoint& endpoint ) const noexcept
+    {
+      return endpoint.hash();
+    }
+  };
+
+} // namespace lite_passthrough_proxy
@@ -0,0 +1,415 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include "coarse_clock.hpp"
+#include "config.hpp"
+#include "endpoint.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## FlowRecord
+   *
+   * TCP 연결 1개 / UDP 세션 1개 = record 1개 (128 bytes 고정).
+   * committed 는 마지막에 release store 해요. reader 는 committed == FLOW_COMMITTED 인 것만 읽어요.
+   *
+   */
+  enum class FlowCloseReason : uint8_t
+  {
+    NONE = 0,
+    CLIENT_CLOSED,
+    UPSTREAM_CLOSED,
+    IDLE_TIMEOUT,
+    CONNECT_FAILED,
+    REJECTED, // security / memory budget
+    ERROR,
+    SHUTDOWN,
+  };
+
+  static constexpr uint32_t FLOW_COMMITTED = 0x464C4F57; // "FLOW"
+
+  struct alignas( 64 ) FlowRecord
+  {
+    uint32_t committed{ 0 };
+    uint8_t protocol{ 0 }; // IPPROTO_TCP / IPPROTO_UDP
+    FlowCloseReason close_reason{ FlowCloseReason::NONE };
+    uint16_t route_port{ 0 };
+
+    Endpoint client;
+    Endpoint upstream;
+
+    uint64_t start_ns{ 0 }; // CLOCK_REALTIME, CoarseClock::realtime_ns()
+    uint64_t end_ns{ 0 };
+
+    uint64_t bytes_in{ 0 }; // client -> upstream
+    uint64_t bytes_out{ 0 };
+    uint64_t packets_in{ 0 };
+    uint64_t packets_out{ 0 };
+  };
+
+  static_assert( sizeof( FlowRecord ) == 128, "FlowRecord must be 128 bytes" );
+
+  struct FlowJournalHeader
+  {
+    char magic[8]{ 'L', 'P', 'P', 'F', 'L', 'O', 'W', '2' }; // 2: 주소가 Endpoint (IPv4 는 v4-mapped)
+    uint32_t record_size{ sizeof( FlowRecord ) };
+    uint32_t header_size{ 4096 };
+    uint64_t capacity{ 0 };
+    uint64_t created_ns{ 0 };
+  };
+
+  /**
+   * ## FlowJournal
+   *
+   * mmap 된 고정 크기 record 파일에 append. worker 는 fetch_add 한번으로 자리를 잡고 memcpy 만 해요 (syscall / 포맷팅 없음).
+   *
+   * - 파일: <path>.<seq>, [header 4KB][record x capacity]. 이미 있는 파일은 O_EXCL 로 건너뛰어요 (재시작 / upgrade 로 두 process 가 겹쳐도 덮어쓰지 않게)
+   * - 꽉 차면 자리를 capacity 번째로 잡은 thread 하나가 다음 segment 로 rotate (드물게 syscall)
+   * - rotate 중에 다른 thread 가 넣은 record 는 기다리지 않고 버리고 dropped 만 올려요
+   * - writer 는 segment 의 writers 를 올리고 쓰니까, 예전 segment 는 writers 가 0 이 된 뒤에만 munmap
+   * - segment 를 못 열면 (디스크 full 등) RETRY_EVERY 번 drop 마다 다시 열어봐요
+   * - options.flow_journal 은 load / reload 때마다 반영돼요. path / segment_records 가 바뀌면 새 segment 로 넘어가고, path 를 비우면 꺼요
+   *
+   * > reader: tools/flow_journal_reader.cpp
+   *
+   */
+  class FlowJournal
+  {
+  private:
+    static constexpr size_t HEADER_SIZE = 4096;
+    static constexpr uint32_t OPEN_ATTEMPTS = 64; // 이미 있는 seq 를 건너뛰는 횟수
+    static constexpr uint64_t RETRY_EVERY = 1024;
+
+    struct Segment
+    {
+      FlowRecord* records{ nullptr };
+      void* base{ nullptr };
+      size_t mapped{ 0 };
+      uint64_t capacity{ 0 };
+      alignas( 64 ) atomic<uint64_t> next{ 0 };
+      alignas( 64 ) atomic<uint32_t> writers{ 0 };
+    };
+
+    string m_path;
+    uint64_t m_capacity{ 0 };
+    uint64_t m_seq{ 0 };
+    bool m_is_open{ false };
+
+    atomic<Segment*> m_current{ nullptr };
+    // mapping 은 writers 가 0 이 되면 풀지만 Segment 자체는 close() 까지 둬요.
+    // m_current 를 읽고 writers 를 올리기 전인 writer 가 있을 수 있어서 (rotate 1 번에 수십 bytes)
+    vector<Segment*> m_retired;
+    mutex m_rotate_mutex; // rotate 는 capacity 번째 writer 하나만 하지만 close() / 재시도와 겹치지 않게
+
+    alignas( 64 ) atomic<uint64_t> m_dropped{ 0 };
+
+    Segment* open_segment() noexcept
+    {
+      int fd = -1;
+
+      for ( uint32_t attempt = 0; attempt < OPEN_ATTEMPTS && fd < 0; ++attempt )
+      {
+        const string file = m_path + "." + to_string( m_seq++ );
+
+        fd = ::open( file.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+        if ( fd < 0 && errno != EEXIST )
+        {
+          return nullptr;
+        }
+      }
+
+      if ( fd < 0 )
+      {
+        return nullptr;
+      }
+
+      const size_t size = HEADER_SIZE + m_capacity * sizeof( FlowRecord );
+      if ( ftruncate( fd, static_cast<off_t>( size ) ) != 0 )
+      {
+        ::close( fd );
+        return nullptr;
+      }
+
+      void* base = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+      ::close( fd );
+
+      if ( base == MAP_FAILED )
+      {
+        return nullptr;
+      }
+
+      FlowJournalHeader header;
+      header.capacity = m_capacity;
+      header.created_ns = CoarseClock::realtime_ns();
+      memcpy( base, &header, sizeof( header ) );
+
+      auto* segment = new Segment();
+      segment->base = base;
+      segment->mapped = size;
+      segment->capacity = m_capacity;
+      segment->records = reinterpret_cast<FlowRecord*>( static_cast<char*>( base ) + HEADER_SIZE );
+
+      return segment;
+    }
+
+    static void unmap_segment( Segment* segment ) noexcept
+    {
+      if ( segment->base )
+      {
+        munmap( segment->base, segment->mapped );
+        segment->base = nullptr;
+        segment->records = nullptr;
+      }
+    }
+
+    // m_rotate_mutex 를 잡고. 늦게 쓰던 writer 가 다 빠진 segment 만 munmap
+    void reclaim() noexcept
+    {
+      for ( Segment* segment : m_retired )
+      {
+        if ( segment->writers.load( memory_order_seq_cst ) == 0 )
+        {
+          unmap_segment( segment );
+        }
+      }
+    }
+
+    // m_rotate_mutex 를 잡고. 실패하면 nullptr -> 이후 record 는 drop 하다가 RETRY_EVERY 마다 다시
+    void replace_current( Segment* expected ) noexcept
+    {
+      if ( m_current.load( memory_order_acquire ) != expected )
+      {
+        return;
+      }
+
+      Segment* next = open_segment();
+      m_current.store( next, memory_order_seq_cst );
+
+      if ( expected )
+      {
+        try
+        {
+          m_retired.push_back( expected );
+        }
+        catch ( ... )
+        {
+          // 못 넣으면 mapping 을 그대로 두고 (leak) 잊어요. munmap 하면 늦은 writer 가 SIGSEGV
+        }
+      }
+
+      reclaim();
+    }
+
+    void rotate( Segment* full ) noexcept
+    {
+      lock_guard lock( m_rotate_mutex );
+      replace_current( full );
+    }
+
+    void retry_open() noexcept
+    {
+      unique_lock lock( m_rotate_mutex, try_to_lock );
+      if ( lock.owns_lock() && m_is_open )
+      {
+        replace_current( nullptr );
+      }
+    }
+
+    // writer 가 segment 를 잡는 동안 rotate 가 munmap 하지 않게 writers 를 올려요.
+    // 올린 뒤에도 m_current 면 rotate 의 reclaim 은 (seq_cst 라) 이 writer 를 봐요
+    Segment* pin() noexcept
+    {
+      while ( true )
+      {
+        Segment* segment = m_current.load( memory_order_seq_cst );
+        if ( !segment )
+        {
+          return nullptr;
+        }
+
+        segment->writers.fetch_add( 1, memory_order_seq_cst );
+        if ( m_current.load( memory_order_seq_cst ) == segment )
+        {
+          return segment;
+        }
+
+        segment->writers.fetch_sub( 1, memory_order_release );
+      }
+    }
+
+    FlowJournal()
+    {
+      ConfigManager::instance().subscribe( [this]( const Config& config ) {
+        const auto& journal = config.options.flow_journal;
+
+        if ( journal.path.empty() )
+        {
+          disable();
+        }
+        else
+        {
+          open( journal.path, journal.segment_records );
+        }
+      } );
+    }
+
+  public:
+    static FlowJournal& instance()
+    {
+      static FlowJournal singleton;
+      return singleton;
+    }
+
+    FlowJournal( const FlowJournal& ) = delete;
+    FlowJournal& operator=( const FlowJournal& ) = delete;
+
+    ~FlowJournal()
+    {
+      close();
+    }
+
+    /**
+     * 이미 열려있으면 지금 segment 는 rotate 처럼 retire 하고 새 path / capacity 로 넘어가요 (append 중이어도 돼요)
+     */
+    bool open( const string& path, uint64_t capacity ) noexcept
+    {
+      if ( path.empty() || capacity == 0 )
+      {
+        return false;
+      }
+
+      lock_guard lock( m_rotate_mutex );
+
+      if ( m_is_open && path == m_path && capacity == m_capacity && m_current.load( memory_order_acquire ) )
+      {
+        return true;
+      }
+
+      try
+      {
+        m_path = path;
+      }
+      catch ( ... )
+      {
+        return false;
+      }
+
+      m_capacity = capacity;
+      m_seq = static_cast<uint64_t>( time( nullptr ) );
+      m_is_open = true;
+
+      replace_current( m_current.load( memory_order_acquire ) );
+
+      return m_current.load( memory_order_acquire ) != nullptr;
+    }
+
+    /**
+     * 이후 record 는 drop. append 중인 writer 가 있어도 돼요 (mapping 은 writers 가 0 이 된 뒤에 풀어요)
+     */
+    void disable() noexcept
+    {
+      lock_guard lock( m_rotate_mutex );
+
+      m_is_open = false;
+
+      if ( Segment* current = m_current.exchange( nullptr, memory_order_seq_cst ) )
+      {
+        try
+        {
+          m_retired.push_back( current );
+        }
+        catch ( ... )
+        {
+          // replace_current 와 같아요. munmap 하면 늦은 writer 가 SIGSEGV
+        }
+      }
+
+      reclaim();
+    }
+
+    /**
+     * worker 를 다 내린 뒤에 (append 중인 writer 가 없어야 해요)
+     */
+    void close() noexcept
+    {
+      lock_guard lock( m_rotate_mutex );
+
+      m_is_open = false;
+
+      if ( Segment* current = m_current.exchange( nullptr, memory_order_seq_cst ) )
+      {
+        unmap_segment( current );
+        delete current;
+      }
+
+      for ( Segment* segment : m_retired )
+      {
+        unmap_segment( segment );
+        delete segment;
+      }
+
+      m_retired.clear();
+    }
+
+    /**
+     * ---------------
+     * APPEND (worker hot path)
+     *
+     */
+    bool append( const FlowRecord& record ) noexcept
+    {
+      Segment* segment = pin();
+      if ( !segment )
+      {
+        if ( m_dropped.fetch_add( 1, memory_order_relaxed ) % RETRY_EVERY == 0 )
+        {
+          retry_open();
+        }
+        return false;
+      }
+
+      const uint64_t i = segment->next.fetch_add( 1, memory_order_relaxed );
+      if ( i >= segment->capacity )
+      {
+        segment->writers.fetch_sub( 1, memory_order_release );
+
+        // rotate 한 thread 는 자기 record 를 새 segment 에 한번 더 시도
+        if ( i == segment->capacity )
+        {
+          rotate( segment );
+          return append( record );
+        }
+
+        m_dropped.fetch_add( 1, memory_order_relaxed );
+        return false;
+      }
+
+      FlowRecord& slot = segment->records[i];
+      memcpy( reinterpret_cast<char*>( &slot ) + sizeof( uint32_t ), reinterpret_cast<const char*>( &record ) + sizeof( uint32_t ), sizeof( FlowRecord ) - sizeof( uint32_t ) );
+      atomic_ref<uint32_t>( slot.committed ).store( FLOW_COMMITTED, memory_order_release );
+
+      segment->writers.fetch_sub( 1, memory_order_release );
+      return true;
+    }
+
+    uint64_t dropped() const noexcept
+    {
+      return m_dropped.load( memory_order_relaxed );
+    }
+  };
+
+} // namespace lite_passthrough_proxy
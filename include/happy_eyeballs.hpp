@@ -0,0 +1,483 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <mutex>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "coarse_clock.hpp"
+#include "config.hpp"
+#include "endpoint.hpp"
+#include "network.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## AddressHistory
+   *
+   * upstream 주소별 connect 성공/실패와 RTT(connect 완료까지 걸린 시간) 기록. 다음 connect 순서를 정할 때 써요.
+   * connect 할 때만 만지니까 mutex 로 충분해요 (packet hot path 아님).
+   *
+   */
+  class AddressHistory
+  {
+  private:
+    static constexpr size_t MAX_ENTRIES = 4096;
+    static constexpr uint64_t FAILURE_PENALTY_MS = 60000; // 최근 실패한 주소는 1분 동안 뒤로
+
+    struct Entry
+    {
+      uint64_t srtt_us{ 0 }; // EWMA (1/8), 0 = 모름
+      uint64_t last_failure_ms{ 0 };
+      uint32_t successes{ 0 };
+      uint32_t failures{ 0 };
+    };
+
+    mutable mutex m_mutex;
+    unordered_map<Endpoint, Entry, EndpointHash> m_entries;
+
+    // connect 할 때만 읽으니 worker loop 캐시 (CoarseClock::now_ms) 대신 진짜 시계. 캐시가 멈춰있으면 penalty 가 안 풀려요
+    static uint64_t now_ms() noexcept
+    {
+      return CoarseClock::read_precise() / 1'000'000ULL;
+    }
+
+    Entry& entry( const Endpoint& addr )
+    {
+      if ( m_entries.size() >= MAX_ENTRIES && !m_entries.contains( addr ) )
+      {
+        m_entries.clear(); // upstream 수는 많지 않아요. 넘치면 그냥 처음부터 다시 배워요
+      }
+
+      return m_entries[addr];
+    }
+
+  public:
+    static AddressHistory& instance()
+    {
+      static AddressHistory singleton;
+      return singleton;
+    }
+
+    void success( const Endpoint& addr, uint64_t rtt_us )
+    {
+      lock_guard lock( m_mutex );
+
+      auto& e = entry( addr );
+      e.srtt_us = e.srtt_us == 0 ? rtt_us : e.srtt_us - ( e.srtt_us >> 3 ) + ( rtt_us >> 3 );
+      e.last_failure_ms = 0;
+      e.successes++;
+    }
+
+    void failure( const Endpoint& addr )
+    {
+      lock_guard lock( m_mutex );
+
+      auto& e = entry( addr );
+      e.last_failure_ms = max<uint64_t>( now_ms(), 1 );
+      e.failures++;
+    }
+
+    uint64_t srtt_us( const Endpoint& addr ) const
+    {
+      lock_guard lock( m_mutex );
+
+      auto it = m_entries.find( addr );
+      return it == m_entries.end() ? 0 : it->second.srtt_us;
+    }
+
+    /**
+     * RFC 8305 4. 정렬 + family 교차
+     *
+     * 1. 최근 실패 없는 것 > 성공 기록 있는 것 > srtt 짧은 것 (나머지는 getaddrinfo(RFC 6724) 순서 유지)
+     * 2. 맨 앞 주소의 family 부터 IPv6 / IPv4 를 하나씩 번갈아서
+     */
+    vector<Endpoint> order( const vector<Endpoint>& addrs ) const
+    {
+      struct Ranked
+      {
+        Endpoint addr;
+        bool is_failed;
+        bool is_known;
+        uint64_t srtt_us;
+      };
+
+      vector<Ranked> ranked;
+      ranked.reserve( addrs.size() );
+
+      {
+        lock_guard lock( m_mutex );
+        const uint64_t now = now_ms();
+
+        for ( const auto& addr : addrs )
+        {
+          auto it = m_entries.find( addr );
+          if ( it == m_entries.end() )
+          {
+            ranked.push_back( { addr, false, false, 0 } );
+            continue;
+          }
+
+          const auto& e = it->second;
+          const bool is_failed = e.last_failure_ms != 0 && now - e.last_failure_ms < FAILURE_PENALTY_MS;
+
+          ranked.push_back( { addr, is_failed, e.successes > 0, e.srtt_us } );
+        }
+      }
+
+      stable_sort( ranked.begin(), ranked.end(), []( const Ranked& a, const Ranked& b ) {
+        if ( a.is_failed != b.is_failed )
+        {
+          return !a.is_failed;
+        }
+
+        if ( a.is_known != b.is_known )
+        {
+          return a.is_known;
+        }
+
+        return a.is_known && a.srtt_us < b.srtt_us;
+      } );
+
+      vector<Endpoint> preferred, other;
+      for ( const auto& r : ranked )
+      {
+        ( r.addr.family == ranked.front().addr.family ? preferred : other ).push_back( r.addr );
+      }
+
+      vector<Endpoint> out;
+      out.reserve( ranked.size() );
+
+      for ( size_t i = 0; i < max( preferred.size(), other.size() ); ++i )
+      {
+        if ( i < preferred.size() )
+        {
+          out.push_back( preferred[i] );
+        }
+
+        if ( i < other.size() )
+        {
+          out.push_back( other[i] );
+        }
+      }
+
+      return out;
+    }
+  };
+
+  /**
+   * ## UpstreamConnector (Happy Eyeballs v2, RFC 8305)
+   *
+   * route 의 resolved_addrs 를 AddressHistory 순서로 정렬하고, connect_attempt_delay 마다 하나씩 non-blocking connect 를 더 띄워요.
+   * 먼저 붙은 소켓 하나만 남기고 나머지는 닫아요. 하나가 실패하면 delay 를 기다리지 않고 바로 다음 주소.
+   * 주소 하나가 죽어있어도 connect_timeout(10초) 대신 delay(250ms) 만큼만 늦어요.
+   *
+   * worker 에서:
+   * 1. start( epfd, context, route, connection ) -> 시도 소켓은 EPOLLOUT 로 epfd 에 등록돼요 (data.ptr = context)
+   * 2. context 에 이벤트가 오면 on_event(), next_timeout_ms() 가 지나면 on_timer()
+   * 3. CONNECTED 면 take() 로 소켓을 받아요 (epoll 에서 빠진 상태라 relay 용으로 다시 등록)
+   *    socket buffer charge(buffer_charged()) 도 같이 넘어가요. 닫을 때 SocketTuning::release()
+   *
+   */
+  class UpstreamConnector
+  {
+  public:
+    enum class State : uint8_t
+    {
+      CONNECTING,
+      CONNECTED,
+      FAILED,
+    };
+
+  private:
+    static constexpr size_t MAX_ATTEMPTS = 8; // 동시에 열려있는 시도
+
+    struct Attempt
+    {
+      int fd;
+      Endpoint addr;
+      uint64_t started_ns;
+      size_t buffer_charged;
+    };
+
+    int m_epfd{ -1 };
+    void* m_context{ nullptr };
+    const SocketProfile* m_profile{ nullptr };
+
+    vector<Endpoint> m_candidates;
+    size_t m_next{ 0 };
+    vector<Attempt> m_attempts;
+
+    uint64_t m_delay_ns{ 0 };
+    uint64_t m_next_attempt_ns{ 0 };
+    uint64_t m_deadline_ns{ 0 };
+    size_t m_immediate{ 0 }; // 실패한 시도 수만큼 delay 없이 바로 띄워요
+
+    State m_state{ State::FAILED };
+    int m_winner{ -1 };
+    size_t m_winner_charged{ 0 };
+    Endpoint m_peer;
+
+    void drop( size_t i, bool is_failure ) noexcept
+    {
+      epoll_ctl( m_epfd, EPOLL_CTL_DEL, m_attempts[i].fd, nullptr );
+      close( m_attempts[i].fd );
+      Network::SocketTuning::release( m_attempts[i].buffer_charged );
+
+      if ( is_failure )
+      {
+        AddressHistory::instance().failure( m_attempts[i].addr );
+
+        // RFC 8305 5. 다른 시도가 아직 connecting 이어도 delay 를 기다리지 않고 다음 settle() 에서 바로 다음 주소
+        m_immediate++;
+      }
+
+      m_attempts.erase( m_attempts.begin() + i );
+    }
+
+    void finish( size_t i ) noexcept
+    {
+      const Attempt winner = m_attempts[i];
+      const uint64_t rtt_us = ( CoarseClock::read_precise() - winner.started_ns ) / 1000;
+
+      AddressHistory::instance().success( winner.addr, rtt_us );
+
+      epoll_ctl( m_epfd, EPOLL_CTL_DEL, winner.fd, nullptr );
+      m_attempts.erase( m_attempts.begin() + i );
+
+      // 진 쪽은 실패로 치지 않아요
+      while ( !m_attempts.empty() )
+      {
+        drop( m_attempts.size() - 1, false );
+      }
+
+      m_winner = winner.fd;
+      m_winner_charged = winner.buffer_charged;
+      m_peer = winner.addr;
+      m_state = State::CONNECTED;
+    }
+
+    /**
+     * 다음 후보로 connect 하나. 즉시 실패(ENETUNREACH 등)하면 기다리지 않고 그 다음 후보
+     */
+    void launch() noexcept
+    {
+      while ( m_next < m_candidates.size() && m_attempts.size() < MAX_ATTEMPTS )
+      {
+        const Endpoint addr = m_candidates[m_next++];
+
+        int fd = socket( addr.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+        if ( fd < 0 )
+        {
+          continue;
+        }
+
+        size_t charged = 0;
+        if ( m_profile )
+        {
+          Network::SocketTuning::apply( fd, *m_profile, charged );
+        }
+
+        sockaddr_in6 sa;
+        const socklen_t len = addr.to_sockaddr( sa );
+        const uint64_t started_ns = CoarseClock::read_precise();
+
+        if ( connect( fd, reinterpret_cast<const sockaddr*>( &sa ), len ) != 0 && errno != EINPROGRESS )
+        {
+          close( fd );
+          Network::SocketTuning::release( charged );
+          AddressHistory::instance().failure( addr );
+          continue; // 바로 실패하면 기다리지 않고 다음
+        }
+
+        epoll_event event{};
+        event.events = EPOLLOUT | EPOLLET;
+        event.data.ptr = m_context;
+
+        if ( epoll_ctl( m_epfd, EPOLL_CTL_ADD, fd, &event ) != 0 )
+        {
+          close( fd );
+          Network::SocketTuning::release( charged );
+          continue;
+        }
+
+        m_attempts.push_back( { fd, addr, started_ns, charged } );
+        m_next_attempt_ns = started_ns + m_delay_ns;
+        return;
+      }
+    }
+
+    State settle() noexcept
+    {
+      if ( m_state != State::CONNECTING )
+      {
+        return m_state;
+      }
+
+      const uint64_t now = CoarseClock::read_precise();
+
+      for ( ; m_immediate > 0; --m_immediate )
+      {
+        launch();
+      }
+
+      // 전부 실패했으면 delay 를 기다리지 않고 다음 후보
+      if ( m_attempts.empty() || now >= m_next_attempt_ns )
+      {
+        launch();
+      }
+
+      if ( now >= m_deadline_ns || ( m_attempts.empty() && m_next >= m_candidates.size() ) )
+      {
+        // connect_timeout 까지 못 붙은 주소는 실패로 기록
+        while ( !m_attempts.empty() )
+        {
+          drop( m_attempts.size() - 1, true );
+        }
+
+        m_state = State::FAILED;
+      }
+
+      return m_state;
+    }
+
+  public:
+    UpstreamConnector() = default;
+    UpstreamConnector( const UpstreamConnector& ) = delete;
+    UpstreamConnector& operator=( const UpstreamConnector& ) = delete;
+
+    ~UpstreamConnector()
+    {
+      abort();
+
+      if ( m_winner >= 0 )
+      {
+        close( m_winner );
+        Network::SocketTuning::release( m_winner_charged );
+      }
+    }
+
+    State start( int epfd, void* context, const Route& route, const OptionConnection& connection ) noexcept
+    {
+      m_epfd = epfd;
+      m_context = context;
+      m_profile = &route.socket_tuning;
+
+      m_candidates = AddressHistory::instance().order( route.resolved_addrs );
+      m_next = 0;
+
+      const uint64_t now = CoarseClock::read_precise();
+      m_delay_ns = static_cast<uint64_t>( connection.connect_attempt_delay ) * 1'000'000ULL;
+      m_deadline_ns = now + static_cast<uint64_t>( connection.connect_timeout ) * 1'000'000ULL;
+      m_immediate = 0;
+      m_state = State::CONNECTING;
+
+      launch();
+
+      return on_event();
+    }
+
+    /**
+     * context 에 EPOLLOUT / EPOLLERR / EPOLLHUP. 어느 시도인지 모르니 poll(0) 한번으로 전부 확인해요
+     */
+    State on_event() noexcept
+    {
+      if ( m_state != State::CONNECTING || m_attempts.empty() )
+      {
+        return settle();
+      }
+
+      array<pollfd, MAX_ATTEMPTS> fds{};
+      for ( size_t i = 0; i < m_attempts.size(); ++i )
+      {
+        fds[i] = { m_attempts[i].fd, POLLOUT, 0 };
+      }
+
+      if ( poll( fds.data(), m_attempts.size(), 0 ) > 0 )
+      {
+        // 뒤에서부터 지워야 index 가 안 밀려요
+        for ( size_t i = m_attempts.size(); i > 0; --i )
+        {
+          const short revents = fds[i - 1].revents;
+          if ( revents == 0 )
+          {
+            continue;
+          }
+
+          int error = 0;
+          socklen_t len = sizeof( error );
+          getsockopt( m_attempts[i - 1].fd, SOL_SOCKET, SO_ERROR, &error, &len );
+
+          if ( error == 0 && ( revents & POLLOUT ) && !( revents & ( POLLERR | POLLHUP ) ) )
+          {
+            finish( i - 1 );
+            return m_state;
+          }
+
+          drop( i - 1, true );
+        }
+      }
+
+      return settle();
+    }
+
+    State on_timer() noexcept
+    {
+      return settle();
+    }
+
+    /**
+     * epoll_wait timeout 계산용. 다음 시도 or 전체 deadline 까지 (ms), CONNECTING 이 아니면 -1
+     */
+    int64_t next_timeout_ms() const noexcept
+    {
+      if ( m_state != State::CONNECTING )
+      {
+        return -1;
+      }
+
+      const uint64_t now = CoarseClock::read_precise();
+      const uint64_t next = m_next < m_candidates.size() ? min( m_next_attempt_ns, m_deadline_ns ) : m_deadline_ns;
+
+      return next <= now ? 0 : static_cast<int64_t>( ( next - now + 999'999 ) / 1'000'000 );
+    }
+
+    /**
+     * CONNECTED 일 때 소켓 소유권을 넘겨요 (이후 close 는 받은 쪽이)
+     */
+    int take() noexcept
+    {
+      const int fd = m_winner;
+      m_winner = -1;
+
+      return fd;
+    }
+
+    size_t buffer_charged() const noexcept
+    {
+      return m_winner_charged;
+    }
+
+    const Endpoint& peer() const noexcept
+    {
+      return m_peer;
+    }
+
+    void abort() noexcept
+    {
+      while ( !m_attempts.empty() )
+      {
+        drop( m_attempts.size() - 1, false );
+      }
+    }
+  };
+
+} // namespace lite_passthrough_proxy
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "config.hpp"
+#include "memory_budget.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## LatencyHistogram
+   *
+   * ns 단위 log-linear histogram. 2 의 거듭제곱 구간마다 16 칸이라 오차 ~6%, 칸은 976 개 (~8KB).
+   * worker 하나가 쓰고 (relaxed fetch_add), 다른 thread 가 snapshot 으로 읽어요.
+   *
+   */
+  class LatencyHistogram
+  {
+  public:
+    static constexpr uint32_t SUB_BITS = 4;
+    static constexpr size_t SUB_COUNT = 1 << SUB_BITS;
+    static constexpr size_t BUCKET_COUNT = ( 64 - SUB_BITS + 1 ) * SUB_COUNT;
+
+    static constexpr size_t index_of( uint64_t ns ) noexcept
+    {
+      if ( ns < SUB_COUNT )
+      {
+        return static_cast<size_t>( ns );
+      }
+
+      const uint32_t exponent = 63 - countl_zero( ns );
+      return ( exponent - SUB_BITS + 1 ) * SUB_COUNT + ( ( ns >> ( exponent - SUB_BITS ) ) & ( SUB_COUNT - 1 ) );
+    }
+
+    // 칸의 하한 (ns)
+    static constexpr uint64_t value_of( size_t index ) noexcept
+    {
+      if ( index < SUB_COUNT )
+      {
+        return index;
+      }
+
+      const uint32_t exponent = static_cast<uint32_t>( index / SUB_COUNT ) + SUB_BITS - 1;
+      return ( SUB_COUNT + index % SUB_COUNT ) << ( exponent - SUB_BITS );
+    }
+
+    /**
+     * ---------------
+     * SNAPSHOT (읽는 쪽, worker 여러개를 합쳐서)
+     *
+     */
+    struct Snapshot
+    {
+      array<uint64_t, BUCKET_COUNT> counts{};
+      uint64_t total{ 0 };
+
+      void merge( const LatencyHistogram& histogram ) noexcept
+      {
+        for ( size_t i = 0; i < BUCKET_COUNT; ++i )
+        {
+          const uint64_t n = histogram.m_counts[i].load( memory_order_relaxed );
+          counts[i] += n;
+          total += n;
+        }
+      }
+
+      // p: 0.0 ~ 1.0, 칸의 상한을 돌려줘요 (없으면 0)
+      uint64_t percentile( double p ) const noexcept
+      {
+        if ( total == 0 )
+        {
+          return 0;
+        }
+
+        const uint64_t rank = max<uint64_t>( 1, static_cast<uint64_t>( p * total + 0.5 ) );
+        uint64_t seen = 0;
+
+        for ( size_t i = 0; i < BUCKET_COUNT; ++i )
+        {
+          seen += counts[i];
+          if ( seen >= rank )
+          {
+            return i + 1 < BUCKET_COUNT ? value_of( i + 1 ) - 1 : value_of( i );
+          }
+        }
+
+        return value_of( BUCKET_COUNT - 1 );
+      }
+    };
+
+  private:
+    array<atomic<uint64_t>, BUCKET_COUNT> m_counts{};
+
+  public:
+    void record( uint64_t ns ) noexcept
+    {
+      m_counts[index_of( ns )].fetch_add( 1, memory_order_relaxed );
+    }
+
+    /**
+     * rx_ns == 0 (timestamp 못 받음) 이거나 시계가 거꾸로면 (settimeofday 등) 버려요
+     */
+    void record_dwell( uint64_t rx_ns, uint64_t sent_ns ) noexcept
+    {
+      if ( rx_ns != 0 && sent_ns >= rx_ns )
+      {
+        record( sent_ns - rx_ns );
+      }
+    }
+
+    void reset() noexcept
+    {
+      for ( auto& count : m_counts )
+      {
+        count.store( 0, memory_order_relaxed );
+      }
+    }
+  };
+
+  static_assert( LatencyHistogram::index_of( LatencyHistogram::value_of( 500 ) ) == 500, "index_of / value_of mismatch" );
+  static_assert( LatencyHistogram::index_of( ~0ULL ) == LatencyHistogram::BUCKET_COUNT - 1, "BUCKET_COUNT too small" );
+
+  /**
+   * ## RouteLatency
+   *
+   * route x worker x 방향마다 histogram 하나 (worker 끼리 cache line 을 다투지 않게). 읽을 때 route 별로 합쳐요.
+   * UDP dwell time (커널 수신 timestamp -> 우리가 send 한 시각) 용이고 두 방향을 따로 재요.
+   *
+   * - FORWARD: client -> upstream. listener 의 BatchIO::send_batch( ..., at( worker, route, Leg::FORWARD ) )
+   * - RETURN: upstream -> client. ReturnBatch::set_histogram( at( worker, route, Leg::RETURN ) )
+   * - route index 는 지금 config.routes 순서, worker 수는 options.worker_threads (0 이면 CPU 수)
+   *
+   * performance.timestamping.enabled 인 config 가 load / reload 될 때마다 table 을 새로 만들어요.
+   * histogram 은 route 의 protocol + src port range 로 찾아서, reload 로 순서가 바뀌어도 같은 route 면 같은 histogram 이에요.
+   * worker 가 예전 포인터를 들고있어도 되게 histogram 도 예전 table 도 지우지 않아요 (새 route / worker 만큼만 늘고, MemoryBudget ARENA 로 잡아요).
+   *
+   */
+  class RouteLatency
+  {
+  public:
+    enum class Leg : uint8_t
+    {
+      FORWARD,
+      RETURN,
+    };
+
+    static constexpr size_t LEG_COUNT = 2;
+
+  private:
+    struct Table
+    {
+      size_t routes{ 0 };
+      size_t workers{ 0 };
+      vector<LatencyHistogram*> histograms; // [( worker * routes + route ) * LEG_COUNT + leg]
+    };
+
+    using RouteKey = tuple<string, uint16_t, uint16_t, size_t>; // protocol, src_port_from, src_port_to, worker
+
+    mutex m_mutex;
+    map<RouteKey, array<unique_ptr<LatencyHistogram>, LEG_COUNT>> m_histograms; // 지금까지 만든 것 전부
+    vector<unique_ptr<Table>> m_tables; // at() 이 lock 없이 읽던 중일 수 있어서 예전 것도 둬요
+    atomic<const Table*> m_table{ nullptr }; // worker 는 lock 없이 읽어요
+
+    static size_t index_of( const Table& table, size_t worker, size_t route, Leg leg ) noexcept
+    {
+      return ( worker * table.routes + route ) * LEG_COUNT + static_cast<size_t>( leg );
+    }
+
+    RouteLatency()
+    {
+      // ConfigManager 가 load 하는 thread 에서 불러요. 여기서 instance() 를 부르면 안돼요
+      ConfigManager::instance().subscribe( [this]( const Config& config ) {
+        if ( config.performance.timestamping.enabled )
+        {
+          const uint32_t workers = config.options.worker_threads > 0 ? config.options.worker_threads : max( thread::hardware_concurrency(), 1u );
+          configure( config.routes, workers );
+        }
+      } );
+    }
+
+  public:
+    static RouteLatency& instance()
+    {
+      static RouteLatency singleton;
+      return singleton;
+    }
+
+    RouteLatency( const RouteLatency& ) = delete;
+    RouteLatency& operator=( const RouteLatency& ) = delete;
+
+    /**
+     * routes 순서대로 새 table 을 올려요. 같은 route / worker 는 예전 histogram 을 그대로 써요. 보통은 config load 가 불러줘요
+     */
+    bool configure( const vector<Route>& routes, size_t workers )
+    {
+      lock_guard lock( m_mutex );
+
+      if ( routes.empty() || workers == 0 )
+      {
+        return false;
+      }
+
+      auto& budget = MemoryBudget::instance();
+
+      auto table = make_unique<Table>();
+      table->routes = routes.size();
+      table->workers = workers;
+      table->histograms.resize( routes.size() * workers * LEG_COUNT );
+      budget.charge( MemoryBudget::Category::ARENA, table->histograms.size() * sizeof( LatencyHistogram* ) );
+
+      for ( size_t worker = 0; worker < workers; ++worker )
+      {
+        for ( size_t route = 0; route < routes.size(); ++route )
+        {
+          auto& legs = m_histograms[RouteKey{ routes[route].protocol, routes[route].src_port_from, routes[route].src_port_to, worker }];
+
+          for ( size_t leg = 0; leg < LEG_COUNT; ++leg )
+          {
+            if ( !legs[leg] )
+            {
+              legs[leg] = make_unique<LatencyHistogram>();
+              budget.charge( MemoryBudget::Category::ARENA, sizeof( LatencyHistogram ) );
+            }
+
+            table->histograms[index_of( *table, worker, route, static_cast<Leg>( leg ) )] = legs[leg].get();
+          }
+        }
+      }
+
+      m_tables.push_back( move( table ) );
+      m_table.store( m_tables.back().get(), memory_order_release );
+
+      return true;
+    }
+
+    /**
+     * 꺼져있거나 범위 밖이면 nullptr (BatchIO / ReturnBatch 는 nullptr 이면 안 재요)
+     */
+    LatencyHistogram* at( size_t worker, size_t route, Leg leg ) noexcept
+    {
+      const Table* table = m_table.load( memory_order_acquire );
+      if ( !table || worker >= table->workers || route >= table->routes )
+      {
+        return nullptr;
+      }
+
+      return table->histograms[index_of( *table, worker, route, leg )];
+    }
+
+    void record_dwell( size_t worker, size_t route, Leg leg, uint64_t rx_ns, uint64_t sent_ns ) noexcept
+    {
+      if ( LatencyHistogram* histogram = at( worker, route, leg ) )
+      {
+        histogram->record_dwell( rx_ns, sent_ns );
+      }
+    }
+
+    LatencyHistogram::Snapshot snapshot( size_t route, Leg leg ) const
+    {
+      LatencyHistogram::Snapshot out;
+
+      const Table* table = m_table.load( memory_order_acquire );
+      if ( !table || route >= table->routes )
+      {
+        return out;
+      }
+
+      for ( size_t worker = 0; worker < table->workers; ++worker )
+      {
+        out.merge( *table->histograms[index_of( *table, worker, route, leg )] );
+      }
+
+      return out;
+    }
+  };
+
+} // namespace lite_passthrough_proxy
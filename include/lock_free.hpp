@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## SpscRing
+   *
+   * producer 1 + consumer 1 bounded ring. 꽉 차면 try_push 가 false (block 하지 않아요).
+   * head / tail 을 서로 다른 cache line 에 두고, 상대 index 는 캐시해서 atomic load 를 줄여요.
+   *
+   */
+  template <typename T, size_t CAPACITY> class alignas( 64 ) SpscRing
+  {
+  private:
+    static_assert( has_single_bit( CAPACITY ), "CAPACITY must be ^2" );
+
+    alignas( 64 ) atomic<size_t> m_head{ 0 }; // consumer 가 씀
+    alignas( 64 ) size_t m_cached_tail{ 0 };  // consumer 전용
+
+    alignas( 64 ) atomic<size_t> m_tail{ 0 }; // producer 가 씀
+    alignas( 64 ) size_t m_cached_head{ 0 };  // producer 전용
+
+    alignas( 64 ) array<T, CAPACITY> m_slots;
+
+  public:
+    [[nodiscard]] bool try_push( const T& value ) noexcept
+    {
+      const size_t tail = m_tail.load( memory_order_relaxed );
+
+      if ( tail - m_cached_head >= CAPACITY )
+      {
+        m_cached_head = m_head.load( memory_order_acquire );
+        if ( tail - m_cached_head >= CAPACITY )
+        {
+          return false;
+        }
+      }
+
+      m_slots[tail & ( CAPACITY - 1 )] = value;
+      m_tail.store( tail + 1, memory_order_release );
+
+      return true;
+    }
+
+    [[nodiscard]] bool try_pop( T& value ) noexcept
+    {
+      const size_t head = m_head.load( memory_order_relaxed );
+
+      if ( head == m_cached_tail )
+      {
+        m_cached_tail = m_tail.load( memory_order_acquire );
+        if ( head == m_cached_tail )
+        {
+          return false;
+        }
+      }
+
+      value = m_slots[head & ( CAPACITY - 1 )];
+      m_head.store( head + 1, memory_order_release );
+
+      return true;
+    }
+
+    size_t size() const noexcept
+    {
+      return m_tail.load( memory_order_acquire ) - m_head.load( memory_order_acquire );
+    }
+  };
+
+  /**
+   * ## MpscRing
+   *
+   * producer N + consumer 1 bounded ring (slot 마다 sequence 를 두는 Vyukov 방식).
+   * producer 끼리는 tail CAS 로 자리만 다투고, 값 쓰기와 공개(sequence store)는 각자 해요. 꽉 차면 try_push 가 false.
+   *
+   */
+  template <typename T, size_t CAPACITY> class alignas( 64 ) MpscRing
+  {
+  private:
+    static_assert( has_single_bit( CAPACITY ), "CAPACITY must be ^2" );
+
+    struct alignas( 64 ) Slot
+    {
+      atomic<size_t> sequence;
+      T value;
+    };
+
+    alignas( 64 ) atomic<size_t> m_tail{ 0 }; // producer 들이 CAS
+    alignas( 64 ) size_t m_head{ 0 };         // consumer 전용
+
+    alignas( 64 ) array<Slot, CAPACITY> m_slots;
+
+  public:
+    MpscRing()
+    {
+      for ( size_t i = 0; i < CAPACITY; ++i )
+      {
+        m_slots[i].sequence.store( i, memory_order_relaxed );
+      }
+    }
+
+    [[nodiscard]] bool try_push( const T& value ) noexcept
+    {
+      size_t tail = m_tail.load( memory_order_relaxed );
+
+      while ( true )
+      {
+        Slot& slot = m_slots[tail & ( CAPACITY - 1 )];
+        const size_t sequence = slot.sequence.load( memory_order_acquire );
+        const intptr_t diff = static_cast<intptr_t>( sequence ) - static_cast<intptr_t>( tail );
+
+        if ( diff == 0 )
+        {
+          if ( m_tail.compare_exchange_weak( tail, tail + 1, memory_order_relaxed ) )
+          {
+            slot.value = value;
+            slot.sequence.store( tail + 1, memory_order_release );
+            return true;
+          }
+        }
+        else if ( diff < 0 )
+        {
+          return false; // 꽉 참
+        }
+        else
+        {
+          tail = m_tail.load( memory_order_relaxed );
+        }
+      }
+    }
+
+    [[nodiscard]] bool try_pop( T& value ) noexcept
+    {
+      Slot& slot = m_slots[m_head & ( CAPACITY - 1 )];
+
+      // 자리는 잡혔지만 아직 값을 쓰는 중인 producer 가 있으면 비어있는 걸로 봐요
+      if ( slot.sequence.load( memory_order_acquire ) != m_head + 1 )
+      {
+        return false;
+      }
+
+      value = slot.value;
+      slot.sequence.store( m_head + CAPACITY, memory_order_release );
+      m_head++;
+
+      return true;
+    }
+  };
+
+} // namespace lite_passthrough_proxy
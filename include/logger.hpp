@@ -0,0 +1,596 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+#include "config.hpp"
+#include "lock_free.hpp"
+
+using namespace std;
+
+/**
+ * 컴파일 타임 최소 log level (0: TRACE ~ 5: OFF). 이보다 낮은 로그는 코드 자체가 사라져요.
+ * > -DLPP_LOG_COMPILE_LEVEL=2
+ */
+#ifndef LPP_LOG_COMPILE_LEVEL
+#define LPP_LOG_COMPILE_LEVEL 1
+#endif
+
+namespace lite_passthrough_proxy
+{
+  enum class LogLevel : uint8_t
+  {
+    TRACE = 0,
+    DEBUG = 1,
+    INFO = 2,
+    WARN = 3,
+    ERROR = 4,
+    OFF = 5,
+  };
+
+  /**
+   * ## Logger
+   *
+   * worker 는 포맷팅도 syscall 도 하지 않아요.
+   *
+   * - LPP_LOG_INFO( "accept fd={} port={}", fd, port ) -> 고정 크기 LogRecord(포맷 문자열 주소 + raw 인자) 를 thread 별 SPSC ring 에 push
+   * - 백그라운드 thread 가 ring 들을 돌면서 포맷팅하고 모아서 write()
+   * - ring 이 꽉 차면 버리고 dropped 카운터만 올려요 (절대 block 안함)
+   * - level 검사는 인자 평가 전에: 컴파일 타임(LPP_LOG_COMPILE_LEVEL) + 런타임(atomic load 1번)
+   *
+   * 포맷 문자열은 literal 만 받아요 (LogFormat 이 consteval 이라 아니면 컴파일 에러). 주소만 저장하거든요.
+   * 문자열 인자(const char*, string, string_view)는 record 안에 복사해요. 합쳐서 TEXT_SIZE 를 넘으면 잘려요.
+   *
+   * options.log_level / log_path 는 load / reload 때마다 반영돼요. log_path 가 바뀌면 그 자리에서 다시 열어요 (logrotate 도).
+   * 반영은 instance() 가 처음 불린 뒤부터라서 main 에서 config load 전에 한번 불러두세요.
+   *
+   * thread 가 끝나면 ring 에 dead 표시만 하고, logger thread 가 다 비운 뒤에 m_rings 에서 빼요 (thread 가 계속 생겼다 없어져도 안 쌓여요).
+   *
+   */
+  class Logger
+  {
+  private:
+    static constexpr size_t MAX_ARGS = 6;
+    static constexpr size_t RING_SIZE = 4096;
+    static constexpr size_t FLUSH_BYTES = 65536;
+    static constexpr size_t TEXT_SIZE = 64;
+
+    enum class ArgType : uint8_t
+    {
+      NONE,
+      INT,
+      UINT,
+      DOUBLE,
+      STRING,
+      POINTER,
+    };
+
+    struct LogRecord
+    {
+      const char* format{ nullptr }; // format id = literal 주소
+      uint64_t timestamp_ns{ 0 };    // CLOCK_REALTIME
+      uint32_t thread_id{ 0 };
+      LogLevel level{ LogLevel::INFO };
+      uint8_t argc{ 0 };
+      uint8_t text_len{ 0 };
+      array<ArgType, MAX_ARGS> types{};
+      array<uint64_t, MAX_ARGS> args{}; // STRING: offset << 32 | len (text 안의 위치)
+      array<char, TEXT_SIZE> text{};
+    };
+
+    struct ThreadRing
+    {
+      SpscRing<LogRecord, RING_SIZE> ring;
+      atomic<uint64_t> dropped{ 0 };
+      atomic<bool> is_dead{ false }; // 주인 thread 가 끝났어요. 더 push 안 해요
+      uint32_t thread_id{ 0 };
+    };
+
+    /**
+     * thread_local 주인. thread 가 끝날 때 ring 에 dead 표시해요
+     */
+    struct RingOwner
+    {
+      shared_ptr<ThreadRing> ring;
+
+      ~RingOwner()
+      {
+        if ( ring )
+        {
+          ring->is_dead.store( true, memory_order_release );
+        }
+      }
+    };
+
+    inline static atomic<LogLevel> s_level{ LogLevel::ERROR };
+    inline static atomic<uint64_t> s_unregistered_dropped{ 0 }; // ring 을 못 만든 thread (bad_alloc 등)
+
+    mutex m_rings_mutex; // ring 등록/순회 때만, hot path 에선 안 잡아요
+    vector<shared_ptr<ThreadRing>> m_rings;
+    atomic<uint32_t> m_thread_counter{ 0 };
+    atomic<uint64_t> m_retired_dropped{ 0 }; // 빼버린 ring 들의 dropped 합
+
+    atomic<bool> m_running{ false };
+    thread m_thread;
+    int m_fd{ -1 }; // start() 때 연 전용 fd (stderr 도 dup 해서). reopen 은 dup3 로 같은 번호에 덮어써요
+    string m_path;
+
+    /**
+     * thread 마다 처음 한번만 allocation + lock. 실패하면 nullptr 이고 그 thread 의 로그는 버려요 (write 는 noexcept)
+     */
+    static shared_ptr<ThreadRing> register_ring() noexcept
+    {
+      try
+      {
+        auto created = make_shared<ThreadRing>();
+        auto& logger = instance();
+
+        created->thread_id = logger.m_thread_counter.fetch_add( 1, memory_order_relaxed );
+
+        lock_guard lock( logger.m_rings_mutex );
+        logger.m_rings.push_back( created );
+
+        return created; // thread 가 끝나도 logger thread 가 다 비울 때까지 m_rings 가 들고 있어요
+      } catch ( ... )
+      {
+        return nullptr;
+      }
+    }
+
+    static ThreadRing* local_ring() noexcept
+    {
+      thread_local RingOwner owner{ register_ring() };
+      return owner.ring.get();
+    }
+
+    static int open_output( const string& log_path ) noexcept
+    {
+      if ( log_path.empty() )
+      {
+        return fcntl( STDERR_FILENO, F_DUPFD_CLOEXEC, 0 );
+      }
+
+      return ::open( log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+    }
+
+    static void pack_text( LogRecord& record, size_t i, string_view text ) noexcept
+    {
+      const size_t offset = record.text_len;
+      const size_t len = min( text.size(), TEXT_SIZE - offset );
+
+      memcpy( record.text.data() + offset, text.data(), len );
+      record.text_len = static_cast<uint8_t>( offset + len );
+
+      record.types[i] = ArgType::STRING;
+      record.args[i] = static_cast<uint64_t>( offset ) << 32 | len;
+    }
+
+    template <typename T> static void pack( LogRecord& record, const T& value ) noexcept
+    {
+      if ( record.argc >= MAX_ARGS )
+      {
+        return;
+      }
+
+      const size_t i = record.argc++;
+
+      if constexpr ( is_same_v<decay_t<T>, bool> )
+      {
+        record.types[i] = ArgType::UINT;
+        record.args[i] = value ? 1 : 0;
+      }
+      else if constexpr ( is_integral_v<T> && is_signed_v<T> )
+      {
+        record.types[i] = ArgType::INT;
+        record.args[i] = static_cast<uint64_t>( static_cast<int64_t>( value ) );
+      }
+      else if constexpr ( is_integral_v<T> || is_enum_v<T> )
+      {
+        record.types[i] = ArgType::UINT;
+        record.args[i] = static_cast<uint64_t>( value );
+      }
+      else if constexpr ( is_floating_point_v<T> )
+      {
+        record.types[i] = ArgType::DOUBLE;
+        record.args[i] = bit_cast<uint64_t>( static_cast<double>( value ) );
+      }
+      else if constexpr ( is_convertible_v<T, const char*> )
+      {
+        const char* text = value;
+        pack_text( record, i, text ? string_view( text ) : string_view( "(null)" ) );
+      }
+      else if constexpr ( is_convertible_v<const T&, string_view> )
+      {
+        pack_text( record, i, string_view( value ) );
+      }
+      else if constexpr ( is_pointer_v<T> )
+      {
+        record.types[i] = ArgType::POINTER;
+        record.args[i] = reinterpret_cast<uint64_t>( value );
+      }
+      else
+      {
+        static_assert( is_pointer_v<T>, "Logger: 정수/실수/포인터/문자열만 넘겨주세요" );
+      }
+    }
+
+    static void append_arg( string& out, const LogRecord& record, ArgType type, uint64_t value )
+    {
+      char buf[32];
+
+      switch ( type )
+      {
+        case ArgType::INT:
+          out.append( buf, snprintf( buf, sizeof( buf ), "%lld", static_cast<long long>( static_cast<int64_t>( value ) ) ) );
+          break;
+        case ArgType::UINT:
+          out.append( buf, snprintf( buf, sizeof( buf ), "%llu", static_cast<unsigned long long>( value ) ) );
+          break;
+        case ArgType::DOUBLE:
+          out.append( buf, snprintf( buf, sizeof( buf ), "%g", bit_cast<double>( value ) ) );
+          break;
+        case ArgType::STRING:
+          out.append( record.text.data() + ( value >> 32 ), value & 0xFFFFFFFF );
+          break;
+        case ArgType::POINTER:
+          out.append( buf, snprintf( buf, sizeof( buf ), "0x%llx", static_cast<unsigned long long>( value ) ) );
+          break;
+        default:
+          break;
+      }
+    }
+
+    static void format( string& out, const LogRecord& record )
+    {
+      static constexpr const char* LEVELS[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "OFF" };
+
+      char head[64];
+      const time_t sec = static_cast<time_t>( record.timestamp_ns / 1'000'000'000ULL );
+      tm utc{};
+      gmtime_r( &sec, &utc );
+
+      size_t len = strftime( head, sizeof( head ), "%Y-%m-%dT%H:%M:%S", &utc );
+      len += snprintf( head + len, sizeof( head ) - len, ".%06lluZ [%s] [%u] ", static_cast<unsigned long long>( record.timestamp_ns / 1000 % 1'000'000 ), LEVELS[static_cast<size_t>( record.level )], record.thread_id );
+      out.append( head, min( len, sizeof( head ) - 1 ) );
+
+      size_t arg = 0;
+      for ( const char* p = record.format; *p; ++p )
+      {
+        if ( p[0] == '{' && p[1] == '}' )
+        {
+          if ( arg < record.argc )
+          {
+            append_arg( out, record, record.types[arg], record.args[arg] );
+            arg++;
+          }
+          ++p;
+          continue;
+        }
+
+        out.push_back( *p );
+      }
+
+      out.push_back( '\n' );
+    }
+
+    void write_out( string& out ) noexcept
+    {
+      size_t offset = 0;
+
+      while ( offset < out.size() )
+      {
+        ssize_t w = ::write( m_fd, out.data() + offset, out.size() - offset );
+        if ( w <= 0 )
+        {
+          break;
+        }
+
+        offset += w;
+      }
+
+      out.clear();
+    }
+
+    /**
+     * ---------------
+     * BACKGROUND THREAD
+     *
+     */
+    void run()
+    {
+      string out;
+      out.reserve( FLUSH_BYTES * 2 );
+
+      vector<shared_ptr<ThreadRing>> rings;
+      vector<shared_ptr<ThreadRing>> dead;
+      uint64_t reported_dropped = 0;
+
+      while ( true )
+      {
+        const bool is_running = m_running.load( memory_order_acquire );
+        {
+          lock_guard lock( m_rings_mutex );
+          rings = m_rings;
+        }
+
+        bool has_work = false;
+
+        for ( auto& ring : rings )
+        {
+          // 비우기 전에 봐야 해요. dead 면 이후 push 가 없으니 다 비운 뒤엔 빼도 돼요
+          const bool is_dead = ring->is_dead.load( memory_order_acquire );
+
+          LogRecord record;
+          while ( ring->ring.try_pop( record ) )
+          {
+            has_work = true;
+            format( out, record );
+
+            if ( out.size() >= FLUSH_BYTES )
+            {
+              write_out( out );
+            }
+          }
+
+          if ( is_dead )
+          {
+            dead.push_back( ring );
+          }
+        }
+
+        if ( !dead.empty() )
+        {
+          retire( dead );
+          dead.clear();
+        }
+
+        const uint64_t dropped = this->dropped();
+        if ( dropped != reported_dropped )
+        {
+          char buf[96];
+          out.append( buf, snprintf( buf, sizeof( buf ), "[logger] dropped %llu records (overload)\n", static_cast<unsigned long long>( dropped - reported_dropped ) ) );
+          reported_dropped = dropped;
+        }
+
+        if ( !out.empty() )
+        {
+          write_out( out );
+        }
+
+        if ( !is_running && !has_work )
+        {
+          break;
+        }
+
+        if ( !has_work )
+        {
+          this_thread::sleep_for( chrono::milliseconds( 5 ) );
+        }
+      }
+    }
+
+    void retire( const vector<shared_ptr<ThreadRing>>& dead ) noexcept
+    {
+      lock_guard lock( m_rings_mutex );
+
+      for ( const auto& ring : dead )
+      {
+        auto it = find( m_rings.begin(), m_rings.end(), ring );
+        if ( it != m_rings.end() )
+        {
+          m_retired_dropped.fetch_add( ring->dropped.load( memory_order_relaxed ), memory_order_relaxed );
+          m_rings.erase( it );
+        }
+      }
+    }
+
+    /**
+     * options.log_level / log_path 반영. listener 안에서 instance() 를 다시 부르면 안 돼서 this 로 잡아요
+     */
+    Logger()
+    {
+      ConfigManager::instance().subscribe( [this]( const Config& config ) { configure( parse_level( config.options.log_level ), config.options.log_path ); } );
+    }
+
+  public:
+    /**
+     * 포맷 문자열 = literal 만 (포인터를 저장해서 나중에 logger thread 가 읽어요)
+     */
+    struct LogFormat
+    {
+      const char* text;
+
+      template <size_t N> consteval LogFormat( const char ( &literal )[N] ) : text( literal ) {}
+    };
+
+    static Logger& instance()
+    {
+      static Logger singleton;
+      return singleton;
+    }
+
+    ~Logger()
+    {
+      stop();
+    }
+
+    static LogLevel parse_level( const string& level ) noexcept
+    {
+      if ( level == "trace" ) return LogLevel::TRACE;
+      if ( level == "debug" ) return LogLevel::DEBUG;
+      if ( level == "info" ) return LogLevel::INFO;
+      if ( level == "warn" || level == "warning" ) return LogLevel::WARN;
+      if ( level == "off" || level == "none" ) return LogLevel::OFF;
+
+      return LogLevel::ERROR;
+    }
+
+    /**
+     * log_path 가 비어있으면 stderr
+     */
+    bool start( LogLevel level, const string& log_path = "" )
+    {
+      if ( m_running.exchange( true ) )
+      {
+        return true;
+      }
+
+      m_fd = open_output( log_path );
+      if ( m_fd < 0 )
+      {
+        m_running.store( false );
+        return false;
+      }
+
+      m_path = log_path;
+      set_level( level );
+      m_thread = thread( &Logger::run, this );
+
+      return true;
+    }
+
+    void stop()
+    {
+      if ( !m_running.exchange( false ) )
+      {
+        return;
+      }
+
+      if ( m_thread.joinable() )
+      {
+        m_thread.join();
+      }
+
+      if ( m_fd >= 0 )
+      {
+        ::close( m_fd );
+        m_fd = -1;
+      }
+    }
+
+    /**
+     * config load / reload 때 (ConfigManager listener). 아직 안 떠있으면 start, 떠있고 log_path 가 바뀌었으면 reopen
+     */
+    bool configure( LogLevel level, const string& log_path )
+    {
+      set_level( level );
+
+      if ( !m_running.load() )
+      {
+        return start( level, log_path );
+      }
+
+      return log_path == m_path || reopen( log_path );
+    }
+
+    /**
+     * 같은 fd 번호에 dup3 로 덮어써서 logger thread 가 쓰는 중이어도 안전해요. 실패하면 원래 파일 그대로
+     */
+    bool reopen( const string& log_path ) noexcept
+    {
+      const int fd = open_output( log_path );
+      if ( fd < 0 )
+      {
+        return false;
+      }
+
+      const bool is_ok = dup3( fd, m_fd, O_CLOEXEC ) >= 0;
+      ::close( fd );
+
+      if ( is_ok )
+      {
+        m_path = log_path;
+      }
+
+      return is_ok;
+    }
+
+    static void set_level( LogLevel level ) noexcept
+    {
+      s_level.store( level, memory_order_relaxed );
+    }
+
+    static bool is_enabled( LogLevel level ) noexcept
+    {
+      return level >= s_level.load( memory_order_relaxed );
+    }
+
+    template <typename... Args> static void write( LogLevel level, LogFormat format, const Args&... args ) noexcept
+    {
+      static_assert( sizeof...( Args ) <= MAX_ARGS, "Logger: 인자는 최대 6개" );
+
+      auto* ring = local_ring();
+      if ( !ring )
+      {
+        s_unregistered_dropped.fetch_add( 1, memory_order_relaxed );
+        return;
+      }
+
+      LogRecord record;
+      record.format = format.text;
+      record.level = level;
+
+      timespec ts{};
+      clock_gettime( CLOCK_REALTIME_COARSE, &ts );
+      record.timestamp_ns = static_cast<uint64_t>( ts.tv_sec ) * 1'000'000'000ULL + ts.tv_nsec;
+
+      ( pack( record, args ), ... );
+      record.thread_id = ring->thread_id;
+
+      if ( !ring->ring.try_push( record ) )
+      {
+        ring->dropped.fetch_add( 1, memory_order_relaxed );
+      }
+    }
+
+    uint64_t dropped() noexcept
+    {
+      uint64_t total = s_unregistered_dropped.load( memory_order_relaxed ) + m_retired_dropped.load( memory_order_relaxed );
+
+      lock_guard lock( m_rings_mutex );
+      for ( const auto& ring : m_rings )
+      {
+        total += ring->dropped.load( memory_order_relaxed );
+      }
+
+      return total;
+    }
+  };
+
+} // namespace lite_passthrough_proxy
+
+/**
+ * level 이 꺼져있으면 인자는 평가되지 않아요.
+ */
+#define LPP_LOG( LEVEL, FORMAT, ... )                                                                           \
+  do                                                                                                            \
+  {                                                                                                             \
+    if constexpr ( static_cast<int>( LEVEL ) >= LPP_LOG_COMPILE_LEVEL )                                         \
+    {                                                                                                           \
+      if ( ::lite_passthrough_proxy::Logger::is_enabled( LEVEL ) )                                              \
+      {                                                                                                         \
+        ::lite_passthrough_proxy::Logger::write( LEVEL, FORMAT __VA_OPT__(, ) __VA_ARGS__ );                    \
+      }                                                                                                         \
+    }                                                                                                           \
+  } while ( 0 )
+
+#define LPP_LOG_TRACE( FORMAT, ... ) LPP_LOG( ::lite_passthrough_proxy::LogLevel::TRACE, FORMAT __VA_OPT__(, ) __VA_ARGS__ )
+#define LPP_LOG_DEBUG( FORMAT, ... ) LPP_LOG( ::lite_passthrough_proxy::LogLevel::DEBUG, FORMAT __VA_OPT__(, ) __VA_ARGS__ )
+#define LPP_LOG_INFO( FORMAT, ... ) LPP_LOG( ::lite_passthrough_proxy::LogLevel::INFO, FORMAT __VA_OPT__(, ) __VA_ARGS__ )
+#define LPP_LOG_WARN( FORMAT, ... ) LPP_LOG( ::lite_passthrough_proxy::LogLevel::WARN, FORMAT __VA_OPT__(, ) __VA_ARGS__ )
+#define LPP_LOG_ERROR( FORMAT, ... ) LPP_LOG( ::lite_passthrough_proxy::LogLevel::ERROR, FORMAT __VA_OPT__(, ) __VA_ARGS__ )
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include "config.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## MemoryBudget
+   *
+   * 프로세스 전체 메모리 사용량을 카테고리별로 추정해서 하나의 budget 으로 관리해요. (README 기준 2GB 머신)
+   *
+   * - NORMAL: 제한 없음
+   * - SHED (soft_percent 이상): 새 TCP accept / 새 UDP 세션 거절, pipe 확장 금지, 새 소켓 buffer 축소
+   * - CRITICAL (hard_percent 이상): SHED + 기존 splice 흐름도 pipe 를 비우고 copy 로 내려가요
+   *
+   * 기존 흐름은 끊지 않아요. 추정치가 틀릴 수 있으니 reconcile() 로 실제 RSS 와 비교해서 큰 쪽을 써요.
+   * (커널 socket buffer / pipe 는 RSS 에 안 잡히니까 추정치만 써요)
+   * limits 가 켜져 있으면 reconcile thread 가 RECONCILE_INTERVAL 마다 불러요.
+   *
+   * 그래도 머신 전체가 모자라면 OOM killer 가 와요. oom_score_adj 를 음수로 주면 다른 process 가 먼저 골라져요.
+   *
+   * hot path 에서 packet 단위로 charge 하지 않아요. 연결/세션 생성, pipe resize, arena 생성 시점에만.
+   * - arena: MemPool 이 만들어질 때 (thread 마다 packet_pool / relay_pool 을 처음 쓸 때) ARENA 로 charge, thread 가 끝나면 uncharge
+   * - accept/세션 생성: admit( CONNECTION | SESSION, 객체 크기 ), 닫을 때 uncharge
+   * - socket buffer: SocketTuning::apply() 가 SOCKET_BUFFER 로 charge, 닫을 때 SocketTuning::release()
+   * - pipe: PipeGovernor 가 알아서 PIPE 로 charge
+   *
+   * performance.memory 는 load / reload 때마다 ConfigManager 가 configure() 로 넣어줘요.
+   *
+   */
+  class MemoryBudget
+  {
+  public:
+    enum class Category : uint8_t
+    {
+      ARENA,         // thread_local MemPool (packet_pool, relay_pool), RouteLatency histogram
+      SOCKET_BUFFER, // 커널 socket buffer (SO_RCVBUF + SO_SNDBUF, 설정값 기준)
+      PIPE,          // splice pipe
+      SESSION,       // UDP session table
+      CONNECTION,    // TCP 연결 객체
+      COUNT,
+    };
+
+    enum class State : uint8_t
+    {
+      NORMAL,
+      SHED,
+      CRITICAL,
+    };
+
+  private:
+    struct alignas( 64 ) Counter
+    {
+      atomic<size_t> bytes{ 0 };
+    };
+
+    array<Counter, static_cast<size_t>( Category::COUNT )> m_counters;
+
+    alignas( 64 ) atomic<size_t> m_limits{ 0 }; // 0 = 무제한
+    atomic<size_t> m_soft{ 0 };
+    atomic<size_t> m_hard{ 0 };
+    atomic<size_t> m_rss{ 0 };
+
+    alignas( 64 ) atomic<uint64_t> m_rejected{ 0 };
+
+    static constexpr size_t MIN_BUFFER = 4096;
+    static constexpr auto RECONCILE_INTERVAL = chrono::seconds( 1 );
+
+    mutex m_reconcile_mutex;
+    condition_variable m_reconcile_cv;
+    bool m_is_reconciling{ false };
+    thread m_reconciler;
+
+    int32_t m_oom_score_adj{ INT_MIN }; // 마지막으로 쓴 값 (INT_MIN = 아직 안 씀)
+
+    MemoryBudget()
+    {
+      ConfigManager::instance().subscribe( [this]( const Config& config ) { configure( config.performance.memory ); } );
+    }
+
+    ~MemoryBudget()
+    {
+      stop_reconciler();
+    }
+
+    void run_reconciler()
+    {
+      unique_lock lock( m_reconcile_mutex );
+
+      while ( m_is_reconciling )
+      {
+        lock.unlock();
+        reconcile();
+        lock.lock();
+
+        m_reconcile_cv.wait_for( lock, RECONCILE_INTERVAL, [this] { return !m_is_reconciling; } );
+      }
+    }
+
+    void start_reconciler() noexcept
+    {
+      lock_guard lock( m_reconcile_mutex );
+      if ( m_is_reconciling )
+      {
+        return;
+      }
+
+      try
+      {
+        m_reconciler = thread( &MemoryBudget::run_reconciler, this );
+        m_is_reconciling = true;
+      }
+      catch ( ... )
+      {
+        // thread 를 못 띄우면 추정치만 써요
+      }
+    }
+
+    void stop_reconciler() noexcept
+    {
+      {
+        lock_guard lock( m_reconcile_mutex );
+        m_is_reconciling = false;
+      }
+
+      m_reconcile_cv.notify_all();
+
+      if ( m_reconciler.joinable() )
+      {
+        m_reconciler.join();
+      }
+
+      m_rss.store( 0, memory_order_relaxed );
+    }
+
+    void apply_oom_score_adj( int32_t value ) noexcept
+    {
+      // 한번도 안 건드렸으면 0 은 그대로 둬요 (부모가 정해준 값 유지)
+      if ( value == m_oom_score_adj || ( value == 0 && m_oom_score_adj == INT_MIN ) )
+      {
+        return;
+      }
+
+      ofstream( "/proc/self/oom_score_adj" ) << value;
+      m_oom_score_adj = value;
+    }
+
+  public:
+    static MemoryBudget& instance()
+    {
+      static MemoryBudget singleton;
+      return singleton;
+    }
+
+    void configure( const PerformanceMemory& memory ) noexcept
+    {
+      m_limits.store( memory.limits, memory_order_relaxed );
+      m_soft.store( memory.limits / 100 * memory.soft_percent, memory_order_relaxed );
+      m_hard.store( memory.limits / 100 * memory.hard_percent, memory_order_relaxed );
+
+      if ( memory.limits > 0 )
+      {
+        start_reconciler();
+      }
+      else
+      {
+        stop_reconciler();
+      }
+
+      apply_oom_score_adj( memory.oom_score_adj );
+    }
+
+    void charge( Category category, size_t bytes ) noexcept
+    {
+      m_counters[static_cast<size_t>( category )].bytes.fetch_add( bytes, memory_order_relaxed );
+    }
+
+    void uncharge( Category category, size_t bytes ) noexcept
+    {
+      m_counters[static_cast<size_t>( category )].bytes.fetch_sub( bytes, memory_order_relaxed );
+    }
+
+    size_t used( Category category ) const noexcept
+    {
+      return m_counters[static_cast<size_t>( category )].bytes.load( memory_order_relaxed );
+    }
+
+    size_t used() const noexcept
+    {
+      size_t total = 0;
+      for ( const auto& counter : m_counters )
+      {
+        total += counter.bytes.load( memory_order_relaxed );
+      }
+
+      // RSS 가 user-space 추정치(ARENA + SESSION + CONNECTION) 보다 크면 그만큼 더해요
+      const size_t estimated_user = used( Category::ARENA ) + used( Category::SESSION ) + used( Category::CONNECTION );
+      const size_t rss = m_rss.load( memory_order_relaxed );
+
+      return rss > estimated_user ? total + ( rss - estimated_user ) : total;
+    }
+
+    State state() const noexcept
+    {
+      if ( m_limits.load( memory_order_relaxed ) == 0 )
+      {
+        return State::NORMAL;
+      }
+
+      const size_t total = used();
+
+      if ( total >= m_hard.load( memory_order_relaxed ) )
+      {
+        return State::CRITICAL;
+      }
+
+      return total >= m_soft.load( memory_order_relaxed ) ? State::SHED : State::NORMAL;
+    }
+
+    /**
+     * ---------------
+     * ADMISSION
+     *
+     * 새 TCP 연결 / UDP 세션 받기 전에 불러요. 통과하면 예상 비용만큼 charge 된 상태.
+     *
+     */
+    [[nodiscard]] bool admit( Category category, size_t estimated_bytes ) noexcept
+    {
+      if ( state() != State::NORMAL )
+      {
+        m_rejected.fetch_add( 1, memory_order_relaxed );
+        return false;
+      }
+
+      charge( category, estimated_bytes );
+      return true;
+    }
+
+    // pipe 확장 같은 "있으면 좋은" 메모리는 NORMAL 일 때만
+    bool can_grow() const noexcept
+    {
+      return state() == State::NORMAL;
+    }
+
+    /**
+     * 새 소켓에 걸 buffer 크기. SHED 면 1/4, CRITICAL 이면 1/8 (최소 MIN_BUFFER)
+     * 0 (설정 안함) 은 그대로 0. CRITICAL 에 0 을 돌려주면 커널 기본값(rmem_default ~208KB)이라 작은 profile 은 오히려 커져요
+     */
+    size_t scale_buffer( size_t size ) const noexcept
+    {
+      if ( size == 0 )
+      {
+        return 0;
+      }
+
+      switch ( state() )
+      {
+        case State::NORMAL:
+          return size;
+        case State::SHED:
+          return max( size >> 2, MIN_BUFFER );
+        default:
+          return max( size >> 3, MIN_BUFFER );
+      }
+    }
+
+    /**
+     * reconcile thread 가 RECONCILE_INTERVAL 마다 불러서 실제 RSS 를 반영해요.
+     */
+    void reconcile() noexcept
+    {
+      size_t pages = 0, resident = 0;
+      ifstream( "/proc/self/statm" ) >> pages >> resident;
+
+      m_rss.store( resident * static_cast<size_t>( sysconf( _SC_PAGESIZE ) ), memory_order_relaxed );
+    }
+
+    uint64_t rejected() const noexcept
+    {
+      return m_rejected.load( memory_order_relaxed );
+    }
+  };
+
+} // namespace lite_passthrough_proxy
@@ -1,22 +1,115 @@
 #pragma once
 
 #include <array>
+#include <cerrno>
 #include <cstddef>
 #include <cstring>
+#include <ctime>
 #include <fcntl.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <span>
 #include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <utility>
+#include "config.hpp"
+#include "endpoint.hpp"
+#include "latency_histogram.hpp"
+#include "memory_budget.hpp"
 #include "pool/mem_pool.hpp"
 
 using namespace std;
 
-namespace LitePassthroughProxy
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+namespace lite_passthrough_proxy
 {
   namespace Network
   {
+    /**
+     * -----
+     * Timestamping
+     *
+     * SO_TIMESTAMPING 으로 커널이 패킷을 받은 시각(software, CLOCK_REALTIME)을 control message 로 받아요.
+     * 우리가 send 한 시각과 빼면 proxy 안에서 머문 시간 (socket queue + worker 처리) 이 나와요.
+     *
+     * - 받는 소켓마다 enable() 한번
+     * - client -> upstream: listener 를 BatchIO::receive_batch 로 받고 같은 slot 으로 prepare() -> send_batch( ..., histogram )
+     * - upstream -> client: 세션 소켓을 recv() 로 ReturnBatch::slot() 에 받고 commit( ..., rx_ns ) -> flush() 가 기록
+     * - 비교하는 쪽도 CLOCK_REALTIME 이라 now_ns() 를 써요 (CoarseClock 은 us 단위 dwell 에는 너무 거칠어요)
+     *
+     */
+    class Timestamping
+    {
+    public:
+      static constexpr size_t CONTROL_SIZE = CMSG_SPACE( sizeof( scm_timestamping ) ); // 64
+
+      static bool enable( int fd ) noexcept
+      {
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        return setsockopt( fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof( flags ) ) == 0;
+      }
+
+      /**
+       * 없으면 0 (enable 안 했거나 control 버퍼가 작아서 MSG_CTRUNC)
+       */
+      static uint64_t rx_ns( const msghdr& msg ) noexcept
+      {
+        for ( auto* cmsg = CMSG_FIRSTHDR( const_cast<msghdr*>( &msg ) ); cmsg; cmsg = CMSG_NXTHDR( const_cast<msghdr*>( &msg ), cmsg ) )
+        {
+          if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPING )
+          {
+            scm_timestamping stamps{};
+            memcpy( &stamps, CMSG_DATA( cmsg ), sizeof( stamps ) );
+
+            // ts[0] = software, ts[2] = raw hardware (안 켰어요)
+            return static_cast<uint64_t>( stamps.ts[0].tv_sec ) * 1'000'000'000ULL + stamps.ts[0].tv_nsec;
+          }
+        }
+
+        return 0;
+      }
+
+      static uint64_t now_ns() noexcept
+      {
+        timespec ts{};
+        clock_gettime( CLOCK_REALTIME, &ts );
+
+        return static_cast<uint64_t>( ts.tv_sec ) * 1'000'000'000ULL + ts.tv_nsec;
+      }
+
+      /**
+       * 세션 소켓용 recv. control 버퍼를 붙여서 받고 수신 시각을 rx_ns 에 (없으면 0)
+       */
+      static ssize_t recv( int fd, span<byte> buffer, uint64_t& rx_ns ) noexcept
+      {
+        alignas( cmsghdr ) byte control[CONTROL_SIZE];
+
+        iovec iov{ buffer.data(), buffer.size() };
+
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof( control );
+
+        const ssize_t r = recvmsg( fd, &msg, MSG_DONTWAIT );
+        rx_ns = r >= 0 && msg.msg_controllen > 0 ? Timestamping::rx_ns( msg ) : 0;
+
+        return r;
+      }
+    };
+
     /**
      * -----
      * BatchIO
@@ -25,12 +118,18 @@ namespace LitePassthroughProxy
     template <size_t BATCH_SIZE = 256> class BatchIO
     {
     private:
+      // IP(V6)_ORIGDSTADDR: CMSG_SPACE( sockaddr_in6 ) = 48, SCM_TIMESTAMPING: 64 -> 둘 다 붙어도 들어가게
+      static constexpr size_t CONTROL_SIZE = 128;
+      static_assert( CONTROL_SIZE >= CMSG_SPACE( sizeof( sockaddr_in6 ) ) + Timestamping::CONTROL_SIZE, "CONTROL_SIZE too small" );
+
       struct alignas( 64 ) BatchBuffer
       {
         array<mmsghdr, BATCH_SIZE> msgs;
         array<iovec, BATCH_SIZE> iovecs; // 오버헤드를 줄이기위해 I/O Vectors 를 써용
-        array<sockaddr_storage, BATCH_SIZE> addrs;
+        array<sockaddr_in6, BATCH_SIZE> addrs; // IPv4/IPv6 둘 다 들어가요 (sockaddr_storage 128 -> 28 bytes)
         array<span<byte>, BATCH_SIZE> buffers;
+        alignas( cmsghdr ) array<array<byte, CONTROL_SIZE>, BATCH_SIZE> controls;
+        array<uint64_t, BATCH_SIZE> rx_ns{}; // prepare() 가 control 을 떼기 전에 옮겨둔 수신 시각 (send_batch 의 dwell 용)
         size_t active_count{ 0 };
 
         BatchBuffer()
@@ -38,7 +137,7 @@ namespace LitePassthroughProxy
           for ( size_t i = 0; i < BATCH_SIZE; ++i )
           {
             msgs[i].msg_hdr.msg_name = &addrs[i];
-            msgs[i].msg_hdr.msg_namelen = sizeof( sockaddr_storage );
+            msgs[i].msg_hdr.msg_namelen = sizeof( sockaddr_in6 );
             msgs[i].msg_hdr.msg_iov = &iovecs[i];
             msgs[i].msg_hdr.msg_iovlen = 1;
             msgs[i].msg_hdr.msg_control = nullptr;
@@ -53,7 +152,7 @@ namespace LitePassthroughProxy
           {
             if ( !buffers[i].empty() )
             {
-              packet_pool<>.release( buffers[i] );
+              packet_pool.release( buffers[i] );
             }
           }
         }
@@ -68,7 +167,7 @@ namespace LitePassthroughProxy
         {
           if ( !m_batch.buffers[i].empty() )
           {
-            packet_pool<>.release( m_batch.buffers[i] );
+            packet_pool.release( m_batch.buffers[i] );
             m_batch.buffers[i] = {};
           }
         }
@@ -76,7 +175,7 @@ namespace LitePassthroughProxy
         size_t allocated = 0;
         for ( size_t i = 0; i < BATCH_SIZE; ++i )
         {
-          m_batch.buffers[i] = packet_pool<>.acquire();
+          m_batch.buffers[i] = packet_pool.acquire();
           if ( m_batch.buffers[i].empty() )
           {
             break;
@@ -84,6 +183,11 @@ namespace LitePassthroughProxy
 
           m_batch.iovecs[i].iov_base = m_batch.buffers[i].data();
           m_batch.iovecs[i].iov_len = m_batch.buffers[i].size();
+
+          // recvmmsg 가 덮어쓰니까 매번 되돌려요
+          m_batch.msgs[i].msg_hdr.msg_namelen = sizeof( sockaddr_in6 );
+          m_batch.msgs[i].msg_hdr.msg_control = m_batch.controls[i].data();
+          m_batch.msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
           allocated++;
         }
 
@@ -95,17 +199,39 @@ namespace LitePassthroughProxy
         int count = recvmmsg( fd, m_batch.msgs.data(), allocated, MSG_DONTWAIT, nullptr );
         m_batch.active_count = ( count > 0 ) ? count : 0;
 
+        // 못 채운 slot 의 버퍼는 바로 반납 (안 그러면 다음 receive 때 덮어써서 새요)
+        for ( size_t i = m_batch.active_count; i < allocated; ++i )
+        {
+          packet_pool.release( m_batch.buffers[i] );
+          m_batch.buffers[i] = {};
+        }
+
         return count;
       }
 
-      static int send_batch( int fd, int count ) noexcept
+      /**
+       * histogram 을 넘기면 실제로 나간 slot 만 (수신 시각 -> sendmmsg 가 돌아온 시각) 으로 기록해요
+       */
+      static int send_batch( int fd, int count, LatencyHistogram* histogram = nullptr ) noexcept
       {
         if ( count <= 0 || count > static_cast<int>( BATCH_SIZE ) )
         {
           return 0;
         }
 
-        return sendmmsg( fd, m_batch.msgs.data(), count, 0 );
+        const int sent = sendmmsg( fd, m_batch.msgs.data(), count, 0 );
+
+        if ( histogram && sent > 0 )
+        {
+          const uint64_t sent_ns = Timestamping::now_ns();
+
+          for ( int i = 0; i < sent; ++i )
+          {
+            histogram->record_dwell( m_batch.rx_ns[i], sent_ns );
+          }
+        }
+
+        return sent;
       }
 
       /**
@@ -113,7 +239,7 @@ namespace LitePassthroughProxy
        * PREPARE BEFORE SEND
        *
        */
-      static bool prepare( size_t i, const void* data, size_t len, const sockaddr_storage* address ) noexcept
+      static bool prepare( size_t i, const void* data, size_t len, const Endpoint* address ) noexcept
       {
         if ( i >= BATCH_SIZE )
         {
@@ -122,7 +248,7 @@ namespace LitePassthroughProxy
 
         if ( m_batch.buffers[i].empty() )
         {
-          m_batch.buffers[i] = packet_pool<>.acquire();
+          m_batch.buffers[i] = packet_pool.acquire();
           if ( m_batch.buffers[i].empty() )
           {
             return false;
@@ -135,10 +261,14 @@ namespace LitePassthroughProxy
         m_batch.iovecs[i].iov_base = m_batch.buffers[i].data();
         m_batch.iovecs[i].iov_len = copy_len;
 
+        // 받을 때 붙은 control message 를 보낼 때 그대로 쓰면 안돼요. 수신 시각만 옮겨둬요 (받은 slot 그대로 보낼 때만 의미가 있어요)
+        m_batch.rx_ns[i] = m_batch.msgs[i].msg_hdr.msg_control ? get_rx_ns( i ) : 0;
+        m_batch.msgs[i].msg_hdr.msg_control = nullptr;
+        m_batch.msgs[i].msg_hdr.msg_controllen = 0;
+
         if ( address )
         {
-          m_batch.addrs[i] = *address;
-          m_batch.msgs[i].msg_hdr.msg_namelen = ( address->ss_family == AF_INET ) ? sizeof( sockaddr_in ) : sizeof( sockaddr_in6 );
+          m_batch.msgs[i].msg_hdr.msg_namelen = address->to_sockaddr( m_batch.addrs[i] );
         }
 
         return true;
@@ -155,7 +285,7 @@ namespace LitePassthroughProxy
         {
           if ( !m_batch.buffers[i].empty() )
           {
-            packet_pool<>.release( m_batch.buffers[i] );
+            packet_pool.release( m_batch.buffers[i] );
             m_batch.buffers[i] = {};
           }
         }
@@ -173,9 +303,9 @@ namespace LitePassthroughProxy
         return m_batch.msgs[idx];
       }
 
-      static sockaddr_storage& get_addr( size_t idx ) noexcept
+      static Endpoint get_addr( size_t idx ) noexcept
       {
-        return m_batch.addrs[idx];
+        return Endpoint::from( m_batch.addrs[idx] );
       }
 
       static span<byte> get_buffer( size_t idx ) noexcept
@@ -183,6 +313,22 @@ namespace LitePassthroughProxy
         return m_batch.buffers[idx];
       }
 
+      /**
+       * Timestamping::enable() 한 소켓이면 커널 수신 시각 (CLOCK_REALTIME ns), 아니면 0
+       * prepare() 뒤에는 control 이 떨어져 있어서 옮겨둔 값을 줘요
+       */
+      static uint64_t get_rx_ns( size_t idx ) noexcept
+      {
+        const msghdr& header = m_batch.msgs[idx].msg_hdr;
+
+        if ( !header.msg_control )
+        {
+          return m_batch.rx_ns[idx];
+        }
+
+        return header.msg_controllen > 0 ? Timestamping::rx_ns( header ) : 0;
+      }
+
       static size_t get_received_bytes( size_t idx ) noexcept
       {
         return m_batch.msgs[idx].msg_len;
@@ -194,6 +340,310 @@ namespace LitePassthroughProxy
       }
     };
 
+    /**
+     * -----
+     * ReturnBatch
+     *
+     * upstream -> client 응답을 세션 구분없이 모아서 client 쪽 listener 소켓으로 sendmmsg 한번에 보내요.
+     * (worker 하나 x UDP listener 하나 당 하나)
+     *
+     * 1. epoll 한번 깨어날 때 readable 한 세션 소켓마다 slot() 에 바로 recv 하고 commit( len, client )
+     * 2. 꽉 차거나 첫 staging 후 flush_deadline_ns 가 지나면 그 자리에서 flush()
+     * 3. wake 처리가 끝나면 남은 것도 flush()
+     *
+     * N 세션 응답 = sendto N 번 -> sendmmsg 1 번
+     *
+     * set_histogram() 을 걸고 세션 소켓을 Timestamping::recv() 로 받아서 그 수신 시각을 commit() 에 넘기면
+     * flush() 에서 실제로 나간 slot 만 sendmmsg 가 돌아온 시각과 빼서 dwell time 을 기록해요. (drop 된 slot 은 빼요)
+     *
+     */
+    template <size_t BATCH_SIZE = 64> class ReturnBatch
+    {
+    private:
+      int m_fd{ -1 };
+      uint64_t m_flush_deadline_ns{ 0 };
+      uint64_t m_first_staged_ns{ 0 };
+
+      array<mmsghdr, BATCH_SIZE> m_msgs{};
+      array<iovec, BATCH_SIZE> m_iovecs{};
+      array<sockaddr_in6, BATCH_SIZE> m_addrs{};
+      array<span<byte>, BATCH_SIZE> m_buffers{};
+      array<uint64_t, BATCH_SIZE> m_rx_ns{};
+      size_t m_count{ 0 };
+
+      LatencyHistogram* m_histogram{ nullptr };
+
+      uint64_t m_dropped{ 0 };
+
+      static uint64_t now_ns() noexcept
+      {
+        timespec ts{};
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+
+        return static_cast<uint64_t>( ts.tv_sec ) * 1'000'000'000ULL + ts.tv_nsec;
+      }
+
+      void release( size_t from, size_t to ) noexcept
+      {
+        for ( size_t i = from; i < to; ++i )
+        {
+          packet_pool.release( m_buffers[i] );
+          m_buffers[i] = {};
+        }
+      }
+
+      // 실제로 나간 [from, to) 만
+      void record( size_t from, size_t to ) noexcept
+      {
+        if ( !m_histogram )
+        {
+          return;
+        }
+
+        const uint64_t sent_ns = Timestamping::now_ns();
+
+        for ( size_t i = from; i < to; ++i )
+        {
+          m_histogram->record_dwell( m_rx_ns[i], sent_ns );
+        }
+      }
+
+    public:
+      ReturnBatch( int listener_fd, uint64_t flush_deadline_ns ) : m_fd( listener_fd ), m_flush_deadline_ns( flush_deadline_ns )
+      {
+        for ( size_t i = 0; i < BATCH_SIZE; ++i )
+        {
+          m_msgs[i].msg_hdr.msg_name = &m_addrs[i];
+          m_msgs[i].msg_hdr.msg_iov = &m_iovecs[i];
+          m_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+      }
+
+      ReturnBatch( const ReturnBatch& ) = delete;
+      ReturnBatch& operator=( const ReturnBatch& ) = delete;
+
+      ~ReturnBatch()
+      {
+        release( 0, BATCH_SIZE );
+      }
+
+      /**
+       * 다음 slot 의 버퍼. 세션 소켓에서 여기로 바로 recv 해요 (복사 없음).
+       * packet_pool 이 바닥나면 빈 span.
+       */
+      span<byte> slot() noexcept
+      {
+        auto& buffer = m_buffers[m_count];
+
+        if ( buffer.empty() )
+        {
+          buffer = packet_pool.acquire();
+        }
+
+        return buffer;
+      }
+
+      void set_histogram( LatencyHistogram* histogram ) noexcept
+      {
+        m_histogram = histogram;
+      }
+
+      void commit( size_t len, const Endpoint& client, uint64_t rx_ns = 0 ) noexcept
+      {
+        m_rx_ns[m_count] = rx_ns;
+        m_iovecs[m_count].iov_base = m_buffers[m_count].data();
+        m_iovecs[m_count].iov_len = len;
+        m_msgs[m_count].msg_hdr.msg_namelen = client.to_sockaddr( m_addrs[m_count] );
+
+        if ( m_count++ == 0 )
+        {
+          m_first_staged_ns = now_ns();
+        }
+
+        if ( m_count == BATCH_SIZE || now_ns() - m_first_staged_ns >= m_flush_deadline_ns )
+        {
+          flush();
+        }
+      }
+
+      /**
+       * EAGAIN 이면 남은 건 버려요. (UDP 니까 재전송은 상위 프로토콜 몫)
+       */
+      int flush() noexcept
+      {
+        size_t sent = 0;
+
+        while ( sent < m_count )
+        {
+          int n = sendmmsg( m_fd, m_msgs.data() + sent, m_count - sent, MSG_DONTWAIT );
+          if ( n > 0 )
+          {
+            record( sent, sent + n );
+          }
+
+          if ( n <= 0 )
+          {
+            if ( n < 0 && errno == EINTR )
+            {
+              continue;
+            }
+
+            // 보낼 수 없는 메시지 하나는 건너뛰고 계속 (EAGAIN 이면 전부 drop)
+            if ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK )
+            {
+              m_dropped++;
+              sent++;
+              continue;
+            }
+
+            m_dropped += m_count - sent;
+            break;
+          }
+
+          sent += n;
+        }
+
+        // 버퍼는 slot 에 그대로 두고 다음 wake 에 재사용 (한가하면 trim())
+        const size_t flushed = m_count;
+        m_count = 0;
+
+        return static_cast<int>( flushed );
+      }
+
+      bool empty() const noexcept
+      {
+        return m_count == 0;
+      }
+
+      /**
+       * staging 된 게 있으면 남은 deadline(ns), 없으면 -1 (epoll_wait timeout 계산용)
+       */
+      int64_t remaining_ns() const noexcept
+      {
+        if ( m_count == 0 )
+        {
+          return -1;
+        }
+
+        const uint64_t elapsed = now_ns() - m_first_staged_ns;
+        return elapsed >= m_flush_deadline_ns ? 0 : static_cast<int64_t>( m_flush_deadline_ns - elapsed );
+      }
+
+      uint64_t dropped() const noexcept
+      {
+        return m_dropped;
+      }
+
+      // 한가할 때 들고있는 packet_pool 블록 반납
+      void trim() noexcept
+      {
+        if ( m_count == 0 )
+        {
+          release( 0, BATCH_SIZE );
+        }
+      }
+    };
+
+    /**
+     * -----
+     * SocketTuning
+     *
+     * route 의 socket_tuning 을 client 쪽(accept/listener), upstream 쪽 소켓 생성 직후에 적용해요.
+     * 일부 옵션이 실패해도 나머지는 계속 적용하고 false 를 돌려줘요.
+     * MemoryBudget 이 SHED 이상이면 buffer 는 줄여서 걸어요.
+     *
+     * 걸린 buffer 크기는 MemoryBudget 에 SOCKET_BUFFER 로 charge 하고 charged 로 돌려줘요.
+     * 연결이 들고 있다가 소켓을 닫을 때 release( charged ).
+     *
+     */
+    class SocketTuning
+    {
+    public:
+      static bool apply( int fd, const SocketProfile& profile, size_t& charged ) noexcept
+      {
+        bool is_ok = true;
+        charged = 0;
+
+        int domain = AF_UNSPEC, type = 0;
+        socklen_t len = sizeof( int );
+        getsockopt( fd, SOL_SOCKET, SO_DOMAIN, &domain, &len );
+        len = sizeof( int );
+        getsockopt( fd, SOL_SOCKET, SO_TYPE, &type, &len );
+
+        const size_t recv_buffer_size = MemoryBudget::instance().scale_buffer( profile.recv_buffer_size );
+        const size_t send_buffer_size = MemoryBudget::instance().scale_buffer( profile.send_buffer_size );
+
+        if ( recv_buffer_size > 0 )
+        {
+          int size = static_cast<int>( recv_buffer_size );
+          if ( setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof( size ) ) == 0 )
+          {
+            charged += recv_buffer_size;
+          }
+          else
+          {
+            is_ok = false;
+          }
+        }
+
+        if ( send_buffer_size > 0 )
+        {
+          int size = static_cast<int>( send_buffer_size );
+          if ( setsockopt( fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof( size ) ) == 0 )
+          {
+            charged += send_buffer_size;
+          }
+          else
+          {
+            is_ok = false;
+          }
+        }
+
+        MemoryBudget::instance().charge( MemoryBudget::Category::SOCKET_BUFFER, charged );
+
+        if ( profile.dscp >= 0 )
+        {
+          int tos = profile.dscp << 2;
+
+          // dual-stack AF_INET6 소켓의 v4-mapped peer 는 IPv4 header 로 나가서 IP_TOS 를 봐요 (IPV6_TCLASS 만으론 DSCP 가 안 붙어요)
+          is_ok &= setsockopt( fd, IPPROTO_IP, IP_TOS, &tos, sizeof( tos ) ) == 0;
+          if ( domain == AF_INET6 )
+          {
+            is_ok &= setsockopt( fd, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof( tos ) ) == 0;
+          }
+        }
+
+        if ( type != SOCK_STREAM )
+        {
+          return is_ok;
+        }
+
+        if ( profile.is_nodelay )
+        {
+          int one = 1;
+          is_ok &= setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) ) == 0;
+        }
+
+        if ( profile.notsent_lowat > 0 )
+        {
+          int lowat = static_cast<int>( profile.notsent_lowat );
+          is_ok &= setsockopt( fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof( lowat ) ) == 0;
+        }
+
+        if ( !profile.congestion.empty() )
+        {
+          is_ok &= setsockopt( fd, IPPROTO_TCP, TCP_CONGESTION, profile.congestion.data(), profile.congestion.size() ) == 0;
+        }
+
+        return is_ok;
+      }
+
+      static void release( size_t charged ) noexcept
+      {
+        MemoryBudget::instance().uncharge( MemoryBudget::Category::SOCKET_BUFFER, charged );
+      }
+    };
+
     /**
      * ---------------
      * Zerocopy Utils
@@ -217,6 +667,283 @@ namespace LitePassthroughProxy
         return vmsplice( fd, iov, nr_segs, SPLICE_F_GIFT | SPLICE_F_NONBLOCK );
       }
     };
+
+    /**
+     * -----
+     * ZeroCopySend (MSG_ZEROCOPY)
+     *
+     * splice 를 못 쓰는 copy 경로에서 큰 send 는 pool block 을 커널에 복사하지 않고 page 를 그대로 물려줘요.
+     * 커널이 다 쓰고 나면 error queue 로 완료 알림(id 범위)이 오고, 그때 block 을 pool 에 돌려줘요.
+     *
+     * - send 한번 = id 하나 (실패한 send 는 id 를 안 써요). 완료 알림은 [lo, hi] 범위로 오고 순서가 바뀔 수 있어요
+     *   그 범위의 entry 만 done 표시하고, 앞에서부터 done 인 것만 빼요
+     * - 보낸 쪽이 block 을 다 썼으면 detach(): 그 block 의 entry 에 release 표시, 그 block 의 send 가 전부 완료되면 pool 로
+     * - 완료 때 block 의 epoch 가 send 때와 같을 때만 release (그 사이 주인이 바뀌었으면 건드리지 않아요)
+     * - 커널이 결국 복사했다는 알림(COPIED)이 절반 넘게 오면 (loopback, SG 없는 NIC) 이 소켓은 zerocopy 끔
+     * - min_size 미만은 그냥 send: page pinning + 알림 비용이 복사보다 비싸요 (보통 ~10KB 부터 이득)
+     * - pool 은 thread_local 이라 포인터를 들고있지 않고 부를 때마다 pool_of() 로 찾아요 (rebalance 로 worker 가 바뀌어도 그 worker 의 pool)
+     *
+     * 완료 알림이 오면 소켓이 EPOLLERR 로 깨어나요. 그때 reap() (FlowRelay::pump 가 알아서 불러요)
+     * 완료 전에 page 를 pool 로 돌리면 재전송에 다른 연결의 데이터가 실려요. 연결을 버릴 때는 ZeroCopyReaper 로 넘겨요 (relay.hpp)
+     *
+     */
+    template <typename POOL, size_t MAX_INFLIGHT = 16> class ZeroCopySend
+    {
+    public:
+      using PoolOf = POOL& ( * )() noexcept;
+
+    private:
+      struct Inflight
+      {
+        uint32_t id{ 0 };
+        bool is_done{ false };
+        bool is_release{ false };
+        uint64_t epoch{ 0 };
+        span<byte> block;
+      };
+
+      static constexpr uint32_t COPIED_SAMPLE = 64;
+
+      PoolOf m_pool_of{ nullptr };
+      int m_fd{ -1 };
+      size_t m_min_size{ 0 };
+      bool m_is_enabled{ false };
+
+      uint32_t m_next_id{ 0 };
+      array<Inflight, MAX_INFLIGHT> m_inflight{};
+      size_t m_head{ 0 };
+      size_t m_count{ 0 };
+
+      uint32_t m_completed{ 0 };
+      uint32_t m_copied{ 0 };
+
+      Inflight& at( size_t i ) noexcept
+      {
+        return m_inflight[( m_head + i ) % MAX_INFLIGHT];
+      }
+
+      // block 마다 아직 완료 안 된 send 수. MAX_INFLIGHT 가 작아서 따로 들고있지 않고 세요
+      size_t pending( const byte* block ) noexcept
+      {
+        size_t n = 0;
+
+        for ( size_t i = 0; i < m_count; ++i )
+        {
+          n += ( at( i ).block.data() == block && !at( i ).is_done ) ? 1 : 0;
+        }
+
+        return n;
+      }
+
+      // block 의 send 가 다 끝났고 detach 됐으면 pool 로. 같은 block 의 다른 entry 는 release 표시를 지워서 한번만
+      void release( const Inflight& entry ) noexcept
+      {
+        if ( !entry.is_release || pending( entry.block.data() ) > 0 )
+        {
+          return;
+        }
+
+        const span<byte> block = entry.block;
+        const uint64_t epoch = entry.epoch;
+
+        for ( size_t i = 0; i < m_count; ++i )
+        {
+          if ( at( i ).block.data() == block.data() )
+          {
+            at( i ).is_release = false;
+          }
+        }
+
+        POOL& pool = m_pool_of();
+        if ( pool.epoch_of( block ) == epoch )
+        {
+          pool.release( block );
+        }
+      }
+
+      void complete( uint32_t lo, uint32_t hi, bool is_copied ) noexcept
+      {
+        for ( size_t i = 0; i < m_count; ++i )
+        {
+          Inflight& entry = at( i );
+
+          // wrap 돼도 lo 기준 거리로 비교해요
+          if ( !entry.is_done && entry.id - lo <= hi - lo )
+          {
+            entry.is_done = true;
+            release( entry );
+          }
+        }
+
+        while ( m_count > 0 && at( 0 ).is_done )
+        {
+          m_head = ( m_head + 1 ) % MAX_INFLIGHT;
+          m_count--;
+        }
+
+        const uint32_t n = hi - lo + 1;
+        m_completed += n;
+        m_copied += is_copied ? n : 0;
+
+        if ( m_completed >= COPIED_SAMPLE )
+        {
+          if ( m_copied * 2 > m_completed )
+          {
+            m_is_enabled = false;
+          }
+
+          m_completed = 0;
+          m_copied = 0;
+        }
+      }
+
+    public:
+      ZeroCopySend() = default;
+      ZeroCopySend( const ZeroCopySend& ) = delete;
+      ZeroCopySend& operator=( const ZeroCopySend& ) = delete;
+
+      // ZeroCopyReaper 로 inflight 를 넘길 때. 넘겨준 쪽은 inflight 가 0 이 돼요
+      ZeroCopySend( ZeroCopySend&& other ) noexcept
+        : m_pool_of( other.m_pool_of ), m_fd( other.m_fd ), m_min_size( other.m_min_size ), m_is_enabled( other.m_is_enabled ), m_next_id( other.m_next_id ), m_inflight( other.m_inflight ), m_head( other.m_head ),
+          m_count( exchange( other.m_count, 0 ) ), m_completed( other.m_completed ), m_copied( other.m_copied )
+      {
+      }
+
+      ZeroCopySend& operator=( ZeroCopySend&& ) = delete;
+
+      bool open( int fd, PoolOf pool_of, size_t min_size ) noexcept
+      {
+        int one = 1;
+
+        m_fd = fd;
+        m_pool_of = pool_of;
+        m_min_size = min_size;
+        m_is_enabled = setsockopt( fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof( one ) ) == 0;
+
+        return m_is_enabled;
+      }
+
+      bool wants( size_t len ) const noexcept
+      {
+        return m_is_enabled && len >= m_min_size && m_count < MAX_INFLIGHT;
+      }
+
+      size_t inflight() const noexcept
+      {
+        return m_count;
+      }
+
+      /**
+       * reaper 가 dup 한 fd 로 완료 알림을 받을 때
+       */
+      void rebind( int fd ) noexcept
+      {
+        m_fd = fd;
+      }
+
+      /**
+       * block 안의 [data, data + len). 성공하면 block 은 detach() + 완료 전까지 pool 로 못 돌아가요
+       * 지금 worker 의 pool block 이 아니면 (완료 때 돌려줄 곳이 없어요) 그냥 복사로 보내요
+       */
+      ssize_t send( span<byte> block, const byte* data, size_t len ) noexcept
+      {
+        POOL& pool = m_pool_of();
+        if ( !pool.is_valid_block( block ) )
+        {
+          return ::send( m_fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT );
+        }
+
+        ssize_t w = ::send( m_fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT | MSG_ZEROCOPY );
+
+        // optmem_max 에 걸리면 이번만 복사로
+        if ( w < 0 && errno == ENOBUFS )
+        {
+          return ::send( m_fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT );
+        }
+
+        if ( w > 0 )
+        {
+          at( m_count ) = Inflight{ m_next_id++, false, false, pool.epoch_of( block ), block };
+          m_count++;
+        }
+
+        return w;
+      }
+
+      /**
+       * block 을 더 안 쓸 때. 아직 커널이 들고있으면 마지막 완료 때 release, 아니면 지금 release (true)
+       */
+      bool detach( span<byte> block ) noexcept
+      {
+        if ( pending( block.data() ) > 0 )
+        {
+          for ( size_t i = 0; i < m_count; ++i )
+          {
+            if ( at( i ).block.data() == block.data() )
+            {
+              at( i ).is_release = true;
+            }
+          }
+
+          return false;
+        }
+
+        m_pool_of().release( block );
+        return true;
+      }
+
+      /**
+       * error queue 의 완료 알림을 다 읽어요. 읽은 알림 수
+       */
+      size_t reap() noexcept
+      {
+        size_t notifications = 0;
+
+        while ( m_count > 0 )
+        {
+          alignas( cmsghdr ) byte control[128];
+
+          msghdr msg{};
+          msg.msg_control = control;
+          msg.msg_controllen = sizeof( control );
+
+          if ( recvmsg( m_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT ) < 0 )
+          {
+            break;
+          }
+
+          for ( auto* cmsg = CMSG_FIRSTHDR( &msg ); cmsg; cmsg = CMSG_NXTHDR( &msg, cmsg ) )
+          {
+            const bool is_recverr = ( cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR ) || ( cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR );
+            if ( !is_recverr )
+            {
+              continue;
+            }
+
+            sock_extended_err err;
+            memcpy( &err, CMSG_DATA( cmsg ), sizeof( err ) );
+
+            if ( err.ee_errno == 0 && err.ee_origin == SO_EE_ORIGIN_ZEROCOPY )
+            {
+              complete( err.ee_info, err.ee_data, ( err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED ) != 0 );
+              notifications++;
+            }
+          }
+        }
+
+        return notifications;
+      }
+
+      /**
+       * 완료 알림을 끝내 못 받을 때 (ZeroCopyReaper 의 마지막 수단). 커널이 page 를 아직 들고있을 수 있어서
+       * pool 로 돌려주지 않고 잊어요 (block 은 그 worker 가 끝날 때까지 빠져요)
+       */
+      void forget() noexcept
+      {
+        m_head = 0;
+        m_count = 0;
+      }
+    };
   } // namespace Network
 
-} // namespace LitePassthroughProxy
\ No newline at end of file
+} // namespace lite_passthrough_proxy
\ No newline at end of file
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "pool/mem_pool.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## NumaTopology
+   *
+   * E5-2680v4 x 2 같은 dual-socket 에서 worker 의 메모리(MemPool arena, 세션 테이블)와 소켓을 같은 node 에 둬요.
+   *
+   * - /sys/devices/system/node/node<N>/cpulist 로 topology 를 읽고
+   * - /sys/class/net/<nic>/device/numa_node 로 NIC 가 붙은 node 를 찾아서 그쪽 CPU 부터 worker 에 배정
+   * - worker thread 시작 직후 bind_thread_memory( node ) -> 이후 malloc / mmap 으로 first-touch 되는 메모리(세션 테이블 등)는 local node
+   * - 이미 touch 된 영역은 bind_region( ptr, len, node ) 로 옮겨요 (mbind + MPOL_MF_MOVE)
+   * - packet_pool / relay_pool 은 static TLS 라서 glibc 가 pthread_create 때 만드는 쪽 thread 에서 0 으로 채워요
+   *   (= 만드는 쪽 node 에 first-touch). 그래서 bind_thread_memory 로는 안 옮겨지고 worker 에서 bind_worker_arenas( node ) 를 불러요
+   *
+   * libnuma 없이 syscall 직접 써요. node 가 하나뿐이거나 /sys 가 없으면 전부 no-op.
+   *
+   */
+  class NumaTopology
+  {
+  public:
+    struct Node
+    {
+      int id{ 0 };
+      vector<int> cpus;
+    };
+
+  private:
+    static constexpr int MPOL_PREFERRED_MODE = 1;
+    static constexpr unsigned MPOL_MF_MOVE_FLAG = 1 << 1;
+
+    vector<Node> m_nodes;
+
+    static vector<int> parse_cpulist( const string& list )
+    {
+      vector<int> cpus;
+      stringstream ss( list );
+      string range;
+
+      while ( getline( ss, range, ',' ) )
+      {
+        if ( range.empty() )
+        {
+          continue;
+        }
+
+        auto dash = range.find( '-' );
+        int from = stoi( range.substr( 0, dash ) );
+        int to = ( dash == string::npos ) ? from : stoi( range.substr( dash + 1 ) );
+
+        for ( int cpu = from; cpu <= to; ++cpu )
+        {
+          cpus.push_back( cpu );
+        }
+      }
+
+      return cpus;
+    }
+
+    static unsigned long node_mask( int node ) noexcept
+    {
+      return ( node >= 0 && node < static_cast<int>( sizeof( unsigned long ) * 8 ) ) ? 1UL << node : 0;
+    }
+
+  public:
+    static NumaTopology discover()
+    {
+      NumaTopology topology;
+      const filesystem::path root{ "/sys/devices/system/node" };
+
+      error_code ec;
+      for ( const auto& entry : filesystem::directory_iterator( root, ec ) )
+      {
+        const string name = entry.path().filename().string();
+        if ( name.rfind( "node", 0 ) != 0 || name.size() <= 4 || !isdigit( static_cast<unsigned char>( name[4] ) ) )
+        {
+          continue;
+        }
+
+        string list;
+        ifstream( entry.path() / "cpulist" ) >> list;
+
+        try
+        {
+          topology.m_nodes.push_back( Node{ .id = stoi( name.substr( 4 ) ), .cpus = parse_cpulist( list ) } );
+        } catch ( const exception& )
+        {}
+      }
+
+      // 단일 node 테스트 머신 / 컨테이너
+      if ( topology.m_nodes.empty() )
+      {
+        Node node;
+        for ( int cpu = 0; cpu < static_cast<int>( thread::hardware_concurrency() ); ++cpu )
+        {
+          node.cpus.push_back( cpu );
+        }
+        topology.m_nodes.push_back( move( node ) );
+      }
+
+      sort( topology.m_nodes.begin(), topology.m_nodes.end(), []( const Node& a, const Node& b ) { return a.id < b.id; } );
+      return topology;
+    }
+
+    bool is_multi_node() const noexcept
+    {
+      return m_nodes.size() > 1;
+    }
+
+    const vector<Node>& nodes() const noexcept
+    {
+      return m_nodes;
+    }
+
+    int node_of_cpu( int cpu ) const noexcept
+    {
+      for ( const auto& node : m_nodes )
+      {
+        if ( find( node.cpus.begin(), node.cpus.end(), cpu ) != node.cpus.end() )
+        {
+          return node.id;
+        }
+      }
+
+      return 0;
+    }
+
+    /**
+     * NIC 가 붙은 node. 모르면(-1, 가상 NIC, loopback) 0
+     */
+    static int nic_node( const string& nic )
+    {
+      if ( nic.empty() )
+      {
+        return 0;
+      }
+
+      int node = -1;
+      ifstream( "/sys/class/net/" + nic + "/device/numa_node" ) >> node;
+
+      return max( node, 0 );
+    }
+
+    /**
+     * worker 별 CPU 순서. cpu_affinity 가 있으면 그 안에서, 없으면 전체 CPU 에서
+     * preferred_node 의 CPU 가 앞으로 오도록 정렬해요 (node 안의 순서는 유지).
+     */
+    vector<int> plan_workers( const vector<int>& cpu_affinity, int preferred_node ) const
+    {
+      vector<int> cpus = cpu_affinity;
+
+      if ( cpus.empty() )
+      {
+        for ( const auto& node : m_nodes )
+        {
+          cpus.insert( cpus.end(), node.cpus.begin(), node.cpus.end() );
+        }
+      }
+
+      stable_partition( cpus.begin(), cpus.end(), [&]( int cpu ) { return node_of_cpu( cpu ) == preferred_node; } );
+      return cpus;
+    }
+
+    /**
+     * ---------------
+     * MEMORY POLICY
+     *
+     * MPOL_PREFERRED 라서 해당 node 가 꽉 차면 다른 node 로 넘어가요 (OOM 대신 느려지는 쪽).
+     *
+     */
+    bool bind_thread_memory( int node ) const noexcept
+    {
+      if ( !is_multi_node() )
+      {
+        return true;
+      }
+
+      unsigned long mask = node_mask( node );
+      return syscall( SYS_set_mempolicy, MPOL_PREFERRED_MODE, &mask, sizeof( mask ) * 8 + 1 ) == 0;
+    }
+
+    bool bind_region( void* ptr, size_t len, int node ) const noexcept
+    {
+      if ( !is_multi_node() || len == 0 )
+      {
+        return true;
+      }
+
+      // mbind 는 page 정렬된 시작 주소가 필요해요
+      const uintptr_t page = static_cast<uintptr_t>( sysconf( _SC_PAGESIZE ) );
+      const uintptr_t begin = reinterpret_cast<uintptr_t>( ptr ) & ~( page - 1 );
+      const uintptr_t end = reinterpret_cast<uintptr_t>( ptr ) + len;
+
+      unsigned long mask = node_mask( node );
+      return syscall( SYS_mbind, begin, end - begin, MPOL_PREFERRED_MODE, &mask, sizeof( mask ) * 8 + 1, MPOL_MF_MOVE_FLAG ) == 0;
+    }
+
+    /**
+     * worker thread 에서 불러요. 이 thread 의 packet_pool / relay_pool 을 node 로 옮기고 앞으로도 거기 두게 해요
+     */
+    bool bind_worker_arenas( int node ) const noexcept
+    {
+      bool is_ok = bind_region( &packet_pool, sizeof( packet_pool ), node );
+      is_ok &= bind_region( &relay_pool, sizeof( relay_pool ), node );
+
+      return is_ok;
+    }
+
+    /**
+     * 패킷을 처리한 softirq CPU. worker 의 CPU 와 node 가 다르면 handoff 후보예요.
+     */
+    static int incoming_cpu( int fd ) noexcept
+    {
+      int cpu = -1;
+      socklen_t len = sizeof( cpu );
+
+      return getsockopt( fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len ) == 0 ? cpu : -1;
+    }
+
+    /**
+     * listener 에 걸어두면 SO_REUSEPORT 그룹 안에서 같은 CPU 로 들어온 연결을 그 CPU 의 worker 가 받아요.
+     */
+    static bool set_incoming_cpu( int fd, int cpu ) noexcept
+    {
+      return setsockopt( fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof( cpu ) ) == 0;
+    }
+  };
+
+} // namespace lite_passthrough_proxy
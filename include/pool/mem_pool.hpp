@@ -5,6 +5,7 @@
 #include <bit>
 #include <cstddef>
 #include <span>
+#include "../memory_budget.hpp"
 
 using namespace std;
 
@@ -18,8 +19,8 @@ namespace lite_passthrough_proxy
   template <size_t BLOCK_SIZE = 65536, size_t POOL_SIZE = 1024> class alignas( 64 ) MemPool
   {
   private:
-    static_assert( has_single_bit( PoolSize ), "PoolSize must be ^2" );
-    static_assert( BlockSize % 64 == 0, "BlockSize must be ^64" );
+    static_assert( has_single_bit( POOL_SIZE ), "POOL_SIZE must be ^2" );
+    static_assert( BLOCK_SIZE % 64 == 0, "BLOCK_SIZE must be ^64" );
 
 
     struct alignas( 64 ) Block
@@ -29,7 +30,7 @@ namespace lite_passthrough_proxy
       atomic<bool> in_use{ false };
     };
 
-    alignas( 64 ) array<Block, PoolSize> m_pool;
+    alignas( 64 ) array<Block, POOL_SIZE> m_pool;
     alignas( 64 ) atomic<uint64_t> m_free_bitmap[POOL_SIZE / 64];
     alignas( 64 ) atomic<uint64_t> m_alloc_counter{ 0 };
 
@@ -40,8 +41,19 @@ namespace lite_passthrough_proxy
       {
         o.store( ~0ULL, memory_order_relaxed );
       }
+
+      // thread_local 이라 thread 마다 하나씩 생겨요. 커서 budget 에 잡아둬요
+      MemoryBudget::instance().charge( MemoryBudget::Category::ARENA, sizeof( *this ) );
+    }
+
+    ~MemPool()
+    {
+      MemoryBudget::instance().uncharge( MemoryBudget::Category::ARENA, sizeof( *this ) );
     }
 
+    MemPool( const MemPool & ) = delete;
+    MemPool &operator=( const MemPool & ) = delete;
+
     [[nodiscard]] span<byte> acquire() noexcept
     {
       const uint64_t ticket = m_alloc_counter.fetch_add( 1, memory_order_relaxed );
@@ -104,6 +116,21 @@ namespace lite_passthrough_proxy
       m_free_bitmap[bitmap_idx].fetch_or( bit, memory_order_release );
     }
 
+    /**
+     * acquire 될 때마다 올라가는 값. 비동기 완료(MSG_ZEROCOPY)를 기다렸다가 release 할 때
+     * 그 사이 block 이 다른 주인에게 넘어가지 않았는지 확인하는 token 으로 써요. (잘못된 block 이면 0)
+     */
+    uint64_t epoch_of( span<byte> block ) const noexcept
+    {
+      if ( !is_valid_block( block ) )
+      {
+        return 0;
+      }
+
+      const size_t i = ( block.data() - reinterpret_cast<const byte *>( &m_pool[0] ) ) / sizeof( Block );
+      return m_pool[i].epoch.load( memory_order_acquire );
+    }
+
     bool is_valid_block( span<byte> block ) const noexcept
     {
       if ( block.empty() || block.size() != BLOCK_SIZE )
@@ -120,5 +147,6 @@ namespace lite_passthrough_proxy
   };
 
   thread_local inline MemPool<> packet_pool;
+  thread_local inline MemPool<16384, 256> relay_pool; // 작은 TCP 흐름 copy relay 용
 
 } // namespace lite_passthrough_proxy
\ No newline at end of file
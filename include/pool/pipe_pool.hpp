@@ -0,0 +1,319 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+#include "../config.hpp"
+#include "../memory_budget.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## PipeGovernor
+   *
+   * splice 경로의 커널 pipe 메모리 총량을 제한해요. (프로세스 전체 하나)
+   *
+   * - 50000 연결 x 양방향 x 64KB(기본 pipe) = 6.4GB 라서 2GB 머신에선 그대로 못써요
+   * - reserve() 가 실패하면 pipe 를 키우지 않고, used > limit 이면 호출자가 read 를 잠깐 멈춰요
+   * - MemoryBudget 에도 PIPE 로 같이 잡혀서, 전체 budget 이 SHED 이상이면 확장도 거절해요
+   * - 비특권 사용자는 fs.pipe-user-pages-soft 를 넘으면 커널이 pipe 를 1 page 로 강제해요
+   * - 한도는 performance.pipe.memory_limits, load / reload 때마다 ConfigManager 가 넣어줘요
+   *
+   */
+  class PipeGovernor
+  {
+  private:
+    alignas( 64 ) atomic<size_t> m_used{ 0 };
+    alignas( 64 ) atomic<size_t> m_limit{ 0 }; // 0 = 무제한
+
+    PipeGovernor()
+    {
+      ConfigManager::instance().subscribe( [this]( const Config& config ) { set_limit( config.performance.pipe.memory_limits ); } );
+    }
+
+  public:
+    static PipeGovernor& instance()
+    {
+      static PipeGovernor singleton;
+      return singleton;
+    }
+
+    void set_limit( size_t limit ) noexcept
+    {
+      m_limit.store( limit, memory_order_relaxed );
+    }
+
+    [[nodiscard]] bool reserve( size_t bytes ) noexcept
+    {
+      const size_t limit = m_limit.load( memory_order_relaxed );
+      size_t used = m_used.load( memory_order_relaxed );
+
+      if ( !MemoryBudget::instance().can_grow() )
+      {
+        return false;
+      }
+
+      do
+      {
+        if ( limit != 0 && used + bytes > limit )
+        {
+          return false;
+        }
+      } while ( !m_used.compare_exchange_weak( used, used + bytes, memory_order_acq_rel, memory_order_relaxed ) );
+
+      MemoryBudget::instance().charge( MemoryBudget::Category::PIPE, bytes );
+      return true;
+    }
+
+    // 최소 크기(page) 는 거절하면 연결 자체를 못 받으니까 한도와 무관하게 잡아요
+    void force_reserve( size_t bytes ) noexcept
+    {
+      m_used.fetch_add( bytes, memory_order_acq_rel );
+      MemoryBudget::instance().charge( MemoryBudget::Category::PIPE, bytes );
+    }
+
+    void release( size_t bytes ) noexcept
+    {
+      m_used.fetch_sub( bytes, memory_order_acq_rel );
+      MemoryBudget::instance().uncharge( MemoryBudget::Category::PIPE, bytes );
+    }
+
+    bool is_pressure() const noexcept
+    {
+      const size_t limit = m_limit.load( memory_order_relaxed );
+      return ( limit != 0 && m_used.load( memory_order_relaxed ) >= limit ) || MemoryBudget::instance().state() == MemoryBudget::State::CRITICAL;
+    }
+
+    size_t used() const noexcept
+    {
+      return m_used.load( memory_order_relaxed );
+    }
+
+    size_t limit() const noexcept
+    {
+      return m_limit.load( memory_order_relaxed );
+    }
+  };
+
+  /**
+   * ## SplicePipe
+   *
+   * 한 방향(socket -> pipe -> socket) 의 pipe 하나. 연결마다 방향별로 하나씩 들고있어요.
+   *
+   * - 시작은 min_size(page). interactive 흐름은 계속 작게 유지
+   * - splice 한번에 pipe 를 가득 채우는 일이 GROW_STREAK 번 연속이면 2배로 키움 (max_size, governor 한도 안에서)
+   * - 평균 chunk 가 pipe 의 1/8 이하로 SHRINK_STREAK 번 연속이면 비어있을 때 절반으로 줄임
+   *
+   */
+  class SplicePipe
+  {
+  private:
+    static constexpr uint32_t GROW_STREAK = 4;
+    static constexpr uint32_t SHRINK_STREAK = 256;
+
+    int m_fds[2]{ -1, -1 };
+
+    size_t m_size{ 0 };
+    size_t m_min_size{ 0 };
+    size_t m_max_size{ 0 };
+    size_t m_buffered{ 0 }; // pipe 안에 남아있는 bytes
+
+    uint32_t m_full_streak{ 0 };
+    uint32_t m_small_streak{ 0 };
+
+    PipeGovernor* m_governor{ nullptr };
+
+    static size_t system_max_size() noexcept
+    {
+      static const size_t value = [] {
+        size_t size = 1048576;
+        ifstream( "/proc/sys/fs/pipe-max-size" ) >> size;
+        return size;
+      }();
+
+      return value;
+    }
+
+    bool resize( size_t size ) noexcept
+    {
+      int result = fcntl( m_fds[1], F_SETPIPE_SZ, static_cast<int>( size ) );
+      if ( result < 0 )
+      {
+        return false;
+      }
+
+      m_size = static_cast<size_t>( result ); // 커널이 2^n page 로 올려줘요
+      return true;
+    }
+
+  public:
+    SplicePipe() = default;
+    SplicePipe( const SplicePipe& ) = delete;
+    SplicePipe& operator=( const SplicePipe& ) = delete;
+
+    ~SplicePipe()
+    {
+      close();
+    }
+
+    /**
+     * max_size 는 send_buffer_size 보다 크게 잡아봐야 socket 이 못 받아가니까 거기서 잘라요.
+     */
+    bool open( const PerformancePipe& pipe, const PerformanceKernelSocket& kernel_socket, PipeGovernor& governor = PipeGovernor::instance() ) noexcept
+    {
+      if ( pipe2( m_fds, O_NONBLOCK | O_CLOEXEC ) != 0 )
+      {
+        return false;
+      }
+
+      const size_t page = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+
+      m_governor = &governor;
+      m_min_size = max( pipe.min_size, page );
+      m_max_size = min( max( pipe.max_size, m_min_size ), system_max_size() );
+
+      if ( kernel_socket.send_buffer_size > 0 )
+      {
+        m_max_size = max( m_min_size, min( m_max_size, kernel_socket.send_buffer_size ) );
+      }
+
+      if ( !resize( m_min_size ) )
+      {
+        m_size = static_cast<size_t>( fcntl( m_fds[1], F_GETPIPE_SZ ) );
+      }
+
+      m_governor->force_reserve( m_size );
+      return true;
+    }
+
+    void close() noexcept
+    {
+      if ( m_fds[0] >= 0 )
+      {
+        ::close( m_fds[0] );
+        ::close( m_fds[1] );
+        m_fds[0] = m_fds[1] = -1;
+      }
+
+      if ( m_governor )
+      {
+        m_governor->release( m_size );
+        m_governor = nullptr;
+      }
+
+      m_size = m_buffered = 0;
+    }
+
+    /**
+     * ---------------
+     * SPLICE ACCOUNTING
+     *
+     * socket -> pipe 로 in 만큼, pipe -> socket 으로 out 만큼 옮긴 뒤 불러주세요.
+     *
+     */
+    void on_transfer( size_t in, size_t out ) noexcept
+    {
+      m_buffered = m_buffered + in - min( m_buffered + in, out );
+
+      if ( in >= m_size )
+      {
+        m_small_streak = 0;
+
+        if ( ++m_full_streak >= GROW_STREAK )
+        {
+          m_full_streak = 0;
+          grow();
+        }
+      }
+      else if ( in > 0 )
+      {
+        m_full_streak = 0;
+
+        if ( in <= ( m_size >> 3 ) && ++m_small_streak >= SHRINK_STREAK )
+        {
+          m_small_streak = 0;
+          shrink();
+        }
+      }
+    }
+
+    bool grow() noexcept
+    {
+      const size_t next = min( m_size << 1, m_max_size );
+      if ( next <= m_size || !m_governor->reserve( next - m_size ) )
+      {
+        return false;
+      }
+
+      const size_t prev = m_size;
+      if ( !resize( next ) )
+      {
+        m_governor->release( next - prev );
+        return false;
+      }
+
+      // 커널이 반올림했을 수 있으니 차이만큼 보정
+      if ( m_size != next )
+      {
+        m_governor->force_reserve( m_size - prev );
+        m_governor->release( next - prev );
+      }
+
+      return true;
+    }
+
+    bool shrink() noexcept
+    {
+      const size_t next = max( m_size >> 1, m_min_size );
+      if ( next >= m_size || m_buffered > next )
+      {
+        return false;
+      }
+
+      const size_t prev = m_size;
+      if ( !resize( next ) ) // 안에 데이터가 더 많으면 EBUSY
+      {
+        return false;
+      }
+
+      m_governor->release( prev - m_size );
+      return true;
+    }
+
+    /**
+     * governor 한도를 넘었으면 이미 pipe 에 든 건 비우되 socket 에서 더 splice 하지 않아요.
+     * FlowRelay 는 pipe 를 비운 뒤 닫고 (charge 반납) copy 경로로 계속 읽어요
+     */
+    bool is_read_paused() const noexcept
+    {
+      return m_governor && m_governor->is_pressure();
+    }
+
+    int read_fd() const noexcept
+    {
+      return m_fds[0];
+    }
+
+    int write_fd() const noexcept
+    {
+      return m_fds[1];
+    }
+
+    size_t size() const noexcept
+    {
+      return m_size;
+    }
+
+    size_t buffered() const noexcept
+    {
+      return m_buffered;
+    }
+  };
+
+} // namespace lite_passthrough_proxy
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+#include "coarse_clock.hpp"
+#include "config.hpp"
+#include "lock_free.hpp"
+#include "relay.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## FlowHandoff
+   *
+   * worker 사이에 넘기는 TCP 연결 1개. relay / pipe 는 포인터째로 넘어가요 (복사 X).
+   *
+   * - context: worker 의 connection 객체, epoll_event.data.ptr 로 그대로 다시 등록
+   * - idle_deadline_tick: CoarseClock::ticks() 기준이라 받는 쪽 timer 에 그대로 다시 걸면 돼요
+   *
+   */
+  struct FlowHandoff
+  {
+    int client_fd{ -1 };
+    int upstream_fd{ -1 };
+    uint32_t client_events{ 0 };
+    uint32_t upstream_events{ 0 };
+
+    FlowRelay* to_upstream{ nullptr };
+    FlowRelay* to_client{ nullptr };
+    void* context{ nullptr };
+
+    uint64_t idle_deadline_tick{ 0 };
+  };
+
+  /**
+   * ## Rebalancer
+   *
+   * SO_REUSEPORT 는 새 연결만 고르게 나눠요. 몇 시간짜리 coturn/XMPP 흐름이 한 worker 에 몰리면
+   * 바쁜 worker 가 한가한 worker 에게 연결을 넘겨요.
+   *
+   * - 부하: worker 마다 loop 의 busy 비율(permille)과 흐름 수를 atomic 으로 공개 (LoadMeter)
+   * - 전달: worker 마다 MpscRing inbox + eventfd (받는 쪽 epoll 에 등록해두고 깨워요)
+   *
+   * 소유권 (한 시점에 연결을 만지는 worker 는 항상 하나):
+   * 1. 보내는 쪽: 이번 epoll_wait batch 의 이벤트를 다 처리한 뒤에만 (처리 안 된 edge 를 들고 넘기지 않게)
+   *    두 relay 가 is_migratable() 일 때 detach() = 두 fd 모두 EPOLL_CTL_DEL, timer 에서 빼고 send()
+   *    send() 가 실패(inbox 가득)하면 attach() 로 자기 epoll 에 다시 걸고 그대로 들고 있어요
+   * 2. 넘어가는 동안 온 데이터는 socket buffer 에 남아있어요. 이벤트는 누구에게도 안 가요
+   * 3. 받는 쪽: receive() 가 attach() = EPOLL_CTL_ADD (EPOLLET) 후 callback 을 불러요
+   *    callback 에서 timer 를 다시 걸고 두 방향 모두 바로 pump() -> DEL ~ ADD 사이에 지나간 edge 를 놓치지 않아요
+   *
+   * MpscRing 의 release/acquire 가 보내는 쪽이 마지막으로 쓴 relay 상태를 받는 쪽에 보여줘요.
+   *
+   */
+  class Rebalancer
+  {
+  public:
+    struct alignas( 64 ) WorkerLoad
+    {
+      atomic<uint32_t> busy_permille{ 0 };
+      atomic<uint32_t> flows{ 0 };
+      atomic<uint64_t> migrated_out{ 0 };
+      atomic<uint64_t> migrated_in{ 0 };
+    };
+
+    /**
+     * worker loop 에서 epoll_wait 앞뒤로 불러서 busy 비율을 재요 (window 마다 한번 publish)
+     */
+    class LoadMeter
+    {
+    private:
+      uint64_t m_window_start{ 0 };
+      uint64_t m_wait_start{ 0 };
+      uint64_t m_idle_ns{ 0 };
+
+    public:
+      void before_wait( uint64_t now_ns ) noexcept
+      {
+        if ( m_window_start == 0 )
+        {
+          m_window_start = now_ns;
+        }
+
+        m_wait_start = now_ns;
+      }
+
+      void after_wait( uint64_t now_ns ) noexcept
+      {
+        m_idle_ns += now_ns - m_wait_start;
+      }
+
+      bool sample( uint64_t now_ns, uint64_t window_ns, uint32_t& busy_permille ) noexcept
+      {
+        const uint64_t elapsed = now_ns - m_window_start;
+        if ( m_window_start == 0 || elapsed < window_ns )
+        {
+          return false;
+        }
+
+        busy_permille = static_cast<uint32_t>( ( elapsed - min( m_idle_ns, elapsed ) ) * 1000 / elapsed );
+
+        m_window_start = now_ns;
+        m_idle_ns = 0;
+
+        return true;
+      }
+    };
+
+  private:
+    static constexpr size_t INBOX_SIZE = 1024;
+
+    struct Worker
+    {
+      WorkerLoad load;
+      MpscRing<FlowHandoff, INBOX_SIZE> inbox;
+      int wake_fd{ -1 };
+
+      // 보내는 쪽(owner) 전용
+      uint64_t window_start_ms{ 0 };
+      uint32_t sent_in_window{ 0 };
+    };
+
+    vector<unique_ptr<Worker>> m_workers;
+    PerformanceRebalance m_config;
+
+  public:
+    static Rebalancer& instance()
+    {
+      static Rebalancer singleton;
+      return singleton;
+    }
+
+    ~Rebalancer()
+    {
+      shutdown();
+    }
+
+    /**
+     * worker 를 띄우기 전에 한번. reload 로 worker_threads 가 바뀌면 worker 를 다 내린 뒤 다시 불러요.
+     */
+    bool configure( size_t workers, const PerformanceRebalance& rebalance ) noexcept
+    {
+      shutdown();
+      m_config = rebalance;
+
+      for ( size_t i = 0; i < workers; ++i )
+      {
+        auto worker = make_unique<Worker>();
+
+        worker->wake_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        if ( worker->wake_fd < 0 )
+        {
+          shutdown();
+          return false;
+        }
+
+        m_workers.push_back( move( worker ) );
+      }
+
+      return true;
+    }
+
+    void shutdown() noexcept
+    {
+      for ( auto& worker : m_workers )
+      {
+        if ( worker->wake_fd >= 0 )
+        {
+          close( worker->wake_fd );
+        }
+      }
+
+      m_workers.clear();
+    }
+
+    /**
+     * worker epoll 에 EPOLLIN 으로 등록해두세요. readable 이면 receive()
+     */
+    int wake_fd( size_t worker ) const noexcept
+    {
+      return worker < m_workers.size() ? m_workers[worker]->wake_fd : -1;
+    }
+
+    const WorkerLoad& load( size_t worker ) const noexcept
+    {
+      return m_workers[worker]->load;
+    }
+
+    void publish( size_t worker, uint32_t flows, uint32_t busy_permille ) noexcept
+    {
+      auto& load = m_workers[worker]->load;
+
+      load.flows.store( flows, memory_order_relaxed );
+      load.busy_permille.store( busy_permille, memory_order_relaxed );
+    }
+
+    /**
+     * ---------------
+     * SEND (보내는 쪽)
+     *
+     */
+
+    /**
+     * 지금 연결 하나를 넘길 곳. 없으면 -1
+     * 내가 high_water 이상이고, 제일 한가한 worker 가 low_water 이하일 때만. interval 마다 max_per_interval 개까지.
+     */
+    int plan( size_t worker ) noexcept
+    {
+      if ( !m_config.enabled || worker >= m_workers.size() || m_workers.size() < 2 )
+      {
+        return -1;
+      }
+
+      auto& self = *m_workers[worker];
+      if ( self.load.busy_permille.load( memory_order_relaxed ) < m_config.high_water_percent * 10 || self.load.flows.load( memory_order_relaxed ) < 2 )
+      {
+        return -1;
+      }
+
+      const uint64_t now_ms = CoarseClock::now_ms();
+      if ( now_ms - self.window_start_ms >= m_config.interval_ms )
+      {
+        self.window_start_ms = now_ms;
+        self.sent_in_window = 0;
+      }
+
+      if ( self.sent_in_window >= m_config.max_per_interval )
+      {
+        return -1;
+      }
+
+      int target = -1;
+      uint32_t lowest = m_config.low_water_percent * 10 + 1;
+
+      for ( size_t i = 0; i < m_workers.size(); ++i )
+      {
+        const uint32_t busy = m_workers[i]->load.busy_permille.load( memory_order_relaxed );
+        if ( i != worker && busy < lowest )
+        {
+          lowest = busy;
+          target = static_cast<int>( i );
+        }
+      }
+
+      return target;
+    }
+
+    static bool detach( int epfd, const FlowHandoff& handoff ) noexcept
+    {
+      if ( !handoff.to_upstream->is_migratable() || !handoff.to_client->is_migratable() )
+      {
+        return false;
+      }
+
+      epoll_ctl( epfd, EPOLL_CTL_DEL, handoff.client_fd, nullptr );
+      epoll_ctl( epfd, EPOLL_CTL_DEL, handoff.upstream_fd, nullptr );
+
+      return true;
+    }
+
+    /**
+     * detach() 한 뒤에. false 면 inbox 가 가득이라 안 넘어갔어요 -> attach() 로 다시 가져가세요
+     */
+    bool send( size_t from, size_t target, const FlowHandoff& handoff ) noexcept
+    {
+      auto& destination = *m_workers[target];
+
+      if ( !destination.inbox.try_push( handoff ) )
+      {
+        return false;
+      }
+
+      uint64_t one = 1;
+      [[maybe_unused]] ssize_t w = write( destination.wake_fd, &one, sizeof( one ) );
+
+      m_workers[from]->sent_in_window++;
+      m_workers[from]->load.migrated_out.fetch_add( 1, memory_order_relaxed );
+
+      return true;
+    }
+
+    /**
+     * ---------------
+     * RECEIVE (받는 쪽)
+     *
+     */
+    static bool attach( int epfd, const FlowHandoff& handoff ) noexcept
+    {
+      epoll_event client{};
+      client.events = handoff.client_events;
+      client.data.ptr = handoff.context;
+
+      epoll_event upstream{};
+      upstream.events = handoff.upstream_events;
+      upstream.data.ptr = handoff.context;
+
+      if ( epoll_ctl( epfd, EPOLL_CTL_ADD, handoff.client_fd, &client ) != 0 )
+      {
+        return false;
+      }
+
+      if ( epoll_ctl( epfd, EPOLL_CTL_ADD, handoff.upstream_fd, &upstream ) != 0 )
+      {
+        epoll_ctl( epfd, EPOLL_CTL_DEL, handoff.client_fd, nullptr );
+        return false;
+      }
+
+      return true;
+    }
+
+    /**
+     * on_arrive( const FlowHandoff&, bool is_attached ): timer 다시 걸고 두 방향 pump().
+     * is_attached 가 false 면 (fd 가 이미 닫힌 경우 등) 연결을 정리하세요.
+     */
+    template <typename OnArrive> size_t receive( size_t worker, int epfd, OnArrive&& on_arrive ) noexcept
+    {
+      auto& self = *m_workers[worker];
+
+      uint64_t count = 0;
+      [[maybe_unused]] ssize_t r = read( self.wake_fd, &count, sizeof( count ) );
+
+      size_t received = 0;
+      FlowHandoff handoff;
+
+      while ( self.inbox.try_pop( handoff ) )
+      {
+        on_arrive( handoff, attach( epfd, handoff ) );
+        received++;
+      }
+
+      self.load.migrated_in.fetch_add( received, memory_order_relaxed );
+
+      return received;
+    }
+  };
+
+} // namespace lite_passthrough_proxy
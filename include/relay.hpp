@@ -0,0 +1,518 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
+#include <memory>
+#include <span>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include "coarse_clock.hpp"
+#include "config.hpp"
+#include "network.hpp"
+#include "pool/mem_pool.hpp"
+#include "pool/pipe_pool.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  enum class RelayStatus : uint8_t
+  {
+    AGAIN,  // EAGAIN, 다음 epoll 이벤트를 기다려요
+    PAUSED, // relay_pool 고갈로 read 를 멈춤. edge 가 다시 안 오니까 호출자가 timer 로 다시 pump() (pipe 한도 초과는 copy 로 내려가요)
+    CLOSED, // from 쪽이 FIN
+    FAILED,
+  };
+
+  using RelayZeroCopy = Network::ZeroCopySend<MemPool<16384, 256>>;
+
+  /**
+   * ## ZeroCopyReaper
+   *
+   * 끊긴 연결의 MSG_ZEROCOPY block 을 완료 알림이 올 때까지 붙잡아두는 worker 별 목록.
+   * 완료 전에 page 를 pool 로 돌리면 재전송 / NIC 큐에 남은 skb 가 다음 주인의 데이터를 싣고 나가요.
+   *
+   * - park(): fd 를 dup 해서 소켓을 살려두고 ZeroCopySend 를 넘겨받아요. 주인은 자기 fd 를 그냥 close 해도 돼요
+   * - reap(): worker loop / timer 에서 불러요. 알림이 다 오면 close
+   * - ABORT_AFTER_NS 가 지나도 남아있으면 (상대가 ACK 를 안 줌) connect( AF_UNSPEC ) 로 RST 하고 write queue 를 비워요.
+   *   그 뒤로도 안 오면 block 을 pool 에 돌려주지 않고 잊은 채로 close
+   *
+   */
+  class ZeroCopyReaper
+  {
+  private:
+    static constexpr uint64_t ABORT_AFTER_NS = 10'000'000'000ULL;
+
+    struct Parked
+    {
+      int fd{ -1 };
+      RelayZeroCopy zerocopy;
+      uint64_t deadline_ns{ 0 };
+      bool is_aborted{ false };
+    };
+
+    vector<unique_ptr<Parked>> m_parked;
+
+    static void abort( int fd ) noexcept
+    {
+      sockaddr unspec{};
+      unspec.sa_family = AF_UNSPEC;
+
+      connect( fd, &unspec, sizeof( unspec ) );
+    }
+
+  public:
+    ZeroCopyReaper() = default;
+    ZeroCopyReaper( const ZeroCopyReaper& ) = delete;
+    ZeroCopyReaper& operator=( const ZeroCopyReaper& ) = delete;
+
+    ~ZeroCopyReaper()
+    {
+      for ( auto& parked : m_parked )
+      {
+        parked->zerocopy.forget();
+        ::close( parked->fd );
+      }
+    }
+
+    /**
+     * false: dup / 메모리 실패로 못 붙잡았어요. 그 block 은 pool 로 안 돌아가고 빠져요
+     */
+    bool park( int fd, RelayZeroCopy&& zerocopy ) noexcept
+    {
+      if ( zerocopy.inflight() == 0 )
+      {
+        return true;
+      }
+
+      const int parked_fd = fcntl( fd, F_DUPFD_CLOEXEC, 0 );
+      if ( parked_fd < 0 )
+      {
+        zerocopy.forget();
+        return false;
+      }
+
+      try
+      {
+        m_parked.push_back( unique_ptr<Parked>( new Parked{ parked_fd, move( zerocopy ), CoarseClock::now_ns() + ABORT_AFTER_NS } ) );
+      }
+      catch ( ... )
+      {
+        zerocopy.forget();
+        ::close( parked_fd );
+        return false;
+      }
+
+      m_parked.back()->zerocopy.rebind( parked_fd );
+      return true;
+    }
+
+    /**
+     * 아직 남아있는 연결 수
+     */
+    size_t reap() noexcept
+    {
+      const uint64_t now = CoarseClock::now_ns();
+
+      for ( size_t i = 0; i < m_parked.size(); )
+      {
+        Parked& parked = *m_parked[i];
+        parked.zerocopy.reap();
+
+        if ( parked.zerocopy.inflight() > 0 && now >= parked.deadline_ns )
+        {
+          if ( !parked.is_aborted )
+          {
+            abort( parked.fd );
+            parked.is_aborted = true;
+            parked.deadline_ns = now + ABORT_AFTER_NS;
+          }
+          else
+          {
+            parked.zerocopy.forget();
+          }
+        }
+
+        if ( parked.zerocopy.inflight() == 0 )
+        {
+          ::close( parked.fd );
+
+          m_parked[i] = move( m_parked.back() );
+          m_parked.pop_back();
+          continue;
+        }
+
+        ++i;
+      }
+
+      return m_parked.size();
+    }
+
+    size_t parked() const noexcept
+    {
+      return m_parked.size();
+    }
+  };
+
+  thread_local inline ZeroCopyReaper zerocopy_reaper;
+
+  /**
+   * ## FlowRelay
+   *
+   * TCP 한 방향(from -> to) relay. 흐름 성격에 따라 경로를 골라요.
+   *
+   * - COPY: recv/send 2 syscall 로 relay_pool block(16KB) 을 거쳐가요. SMTP 커맨드, XMPP stanza 같은 작은 흐름
+   * - SPLICE: socket -> pipe -> socket zero-copy. bulk 흐름
+   *
+   * read 크기의 EWMA 가 SPLICE_THRESHOLD 이상으로 SWITCH_STREAK 번 연속이면 SPLICE,
+   * COPY_THRESHOLD 이하로 SWITCH_STREAK 번 연속이면 COPY. 두 임계값 사이는 그대로 유지해서 flapping 을 막아요.
+   * 전환은 현재 경로에 남은 데이터(copy pending / pipe buffered)가 없을 때만 일어나요.
+   *
+   * performance.zerocopy 가 켜져 있으면 COPY 경로의 큰 send 는 MSG_ZEROCOPY (ZeroCopySend).
+   * 그 block 은 커널 완료 알림이 올 때까지 pool 로 안 돌아가고, 다음 recv 는 새 block 으로 받아요.
+   * 알림이 남은 채로 relay 가 사라지면 zerocopy_reaper 가 넘겨받아요 (worker 가 zerocopy_reaper.reap() 을 주기적으로 불러야 해요).
+   *
+   */
+  class FlowRelay
+  {
+  public:
+    enum class Mode : uint8_t
+    {
+      COPY,
+      SPLICE,
+    };
+
+  private:
+    static constexpr size_t SPLICE_THRESHOLD = 8192;
+    static constexpr size_t COPY_THRESHOLD = 1024;
+    static constexpr uint32_t SWITCH_STREAK = 8;
+
+    int m_from{ -1 };
+    int m_to{ -1 };
+
+    Mode m_mode{ Mode::COPY };
+    SplicePipe m_pipe;
+    bool m_is_pipe_open{ false };
+
+    const PerformancePipe* m_pipe_config{ nullptr };
+    const PerformanceKernelSocket* m_kernel_socket{ nullptr };
+
+    span<byte> m_block;
+    size_t m_pending_offset{ 0 };
+    size_t m_pending_len{ 0 };
+
+    RelayZeroCopy m_zerocopy;
+    bool m_is_block_zerocopy{ false }; // m_block 이 커널에 물려있어요 (release 대신 detach)
+
+    size_t m_avg_chunk{ 0 }; // EWMA (1/8)
+    uint32_t m_streak{ 0 };
+
+    uint64_t m_bytes{ 0 };
+
+    void observe( size_t chunk ) noexcept
+    {
+      m_avg_chunk = m_avg_chunk - ( m_avg_chunk >> 3 ) + ( chunk >> 3 );
+      m_bytes += chunk;
+
+      const bool wants_splice = m_mode == Mode::COPY && m_avg_chunk >= SPLICE_THRESHOLD;
+      const bool wants_copy = m_mode == Mode::SPLICE && m_avg_chunk <= COPY_THRESHOLD;
+
+      m_streak = ( wants_splice || wants_copy ) ? m_streak + 1 : 0;
+    }
+
+    void maybe_switch() noexcept
+    {
+      if ( m_streak < SWITCH_STREAK )
+      {
+        return;
+      }
+
+      if ( m_mode == Mode::COPY && m_pending_len == 0 )
+      {
+        // pipe 메모리가 모자라면 copy 로 버텨요
+        if ( PipeGovernor::instance().is_pressure() || !MemoryBudget::instance().can_grow() || !ensure_pipe() )
+        {
+          return;
+        }
+
+        release_block();
+        m_mode = Mode::SPLICE;
+        m_streak = 0;
+      }
+      else if ( m_mode == Mode::SPLICE && m_pipe.buffered() == 0 )
+      {
+        m_pipe.close();
+        m_is_pipe_open = false;
+        m_mode = Mode::COPY;
+        m_streak = 0;
+      }
+    }
+
+    bool ensure_pipe() noexcept
+    {
+      if ( !m_is_pipe_open )
+      {
+        m_is_pipe_open = m_pipe.open( *m_pipe_config, *m_kernel_socket );
+      }
+
+      return m_is_pipe_open;
+    }
+
+    void release_block() noexcept
+    {
+      if ( !m_block.empty() )
+      {
+        if ( m_is_block_zerocopy )
+        {
+          m_zerocopy.detach( m_block );
+          m_is_block_zerocopy = false;
+        }
+        else
+        {
+          relay_pool.release( m_block );
+        }
+
+        m_block = {};
+      }
+    }
+
+    // rebalance 로 worker 가 바뀌어도 지금 thread 의 relay_pool
+    static MemPool<16384, 256>& current_pool() noexcept
+    {
+      return relay_pool;
+    }
+
+    static bool is_again() noexcept
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    /**
+     * ---------------
+     * COPY PATH
+     *
+     */
+    RelayStatus flush_pending() noexcept
+    {
+      while ( m_pending_len > 0 )
+      {
+        ssize_t w = -1;
+
+        if ( m_zerocopy.wants( m_pending_len ) )
+        {
+          w = m_zerocopy.send( m_block, m_block.data() + m_pending_offset, m_pending_len );
+          m_is_block_zerocopy |= w > 0;
+        }
+        else
+        {
+          w = send( m_to, m_block.data() + m_pending_offset, m_pending_len, MSG_NOSIGNAL | MSG_DONTWAIT );
+        }
+
+        if ( w < 0 )
+        {
+          return is_again() ? RelayStatus::AGAIN : RelayStatus::FAILED;
+        }
+
+        m_pending_offset += w;
+        m_pending_len -= w;
+      }
+
+      // 커널이 아직 읽고있는 block 에 다음 recv 를 덮어쓰면 안돼요
+      if ( m_is_block_zerocopy )
+      {
+        release_block();
+      }
+
+      return RelayStatus::AGAIN;
+    }
+
+    RelayStatus pump_copy() noexcept
+    {
+      RelayStatus pending = flush_pending();
+      if ( pending != RelayStatus::AGAIN || m_pending_len > 0 )
+      {
+        return pending;
+      }
+
+      while ( true )
+      {
+        if ( m_block.empty() )
+        {
+          m_block = relay_pool.acquire();
+          if ( m_block.empty() )
+          {
+            return RelayStatus::PAUSED;
+          }
+        }
+
+        ssize_t r = recv( m_from, m_block.data(), m_block.size(), MSG_DONTWAIT );
+        if ( r <= 0 )
+        {
+          release_block(); // idle 흐름은 block 을 들고있지 않아요
+
+          if ( r == 0 )
+          {
+            return RelayStatus::CLOSED;
+          }
+          return is_again() ? RelayStatus::AGAIN : RelayStatus::FAILED;
+        }
+
+        observe( static_cast<size_t>( r ) );
+
+        m_pending_offset = 0;
+        m_pending_len = static_cast<size_t>( r );
+
+        RelayStatus status = flush_pending();
+        if ( status != RelayStatus::AGAIN || m_pending_len > 0 )
+        {
+          return status;
+        }
+
+        maybe_switch();
+        if ( m_mode != Mode::COPY )
+        {
+          return pump_splice();
+        }
+      }
+    }
+
+    /**
+     * ---------------
+     * SPLICE PATH
+     *
+     */
+    RelayStatus drain_pipe() noexcept
+    {
+      while ( m_pipe.buffered() > 0 )
+      {
+        ssize_t w = Network::ZeroCopyTransfer::splice_data( m_pipe.read_fd(), m_to, m_pipe.buffered() );
+        if ( w <= 0 )
+        {
+          return ( w < 0 && is_again() ) ? RelayStatus::AGAIN : RelayStatus::FAILED;
+        }
+
+        m_pipe.on_transfer( 0, static_cast<size_t>( w ) );
+      }
+
+      return RelayStatus::AGAIN;
+    }
+
+    RelayStatus pump_splice() noexcept
+    {
+      while ( true )
+      {
+        RelayStatus status = drain_pipe();
+
+        if ( status != RelayStatus::AGAIN || m_pipe.buffered() > 0 )
+        {
+          return status;
+        }
+
+        maybe_switch();
+        if ( m_mode != Mode::SPLICE )
+        {
+          return pump_copy();
+        }
+
+        // 한도를 넘었으면 (pipe 는 여기서 비어있어요) pipe 를 닫아 charge 를 돌려주고 copy 로 계속 읽어요.
+        // PAUSED 로 멈추면 EPOLLET 라 socket 에 남은 데이터로는 다시 안 깨어나고, 읽지 않으니 streak 도 안 올라가서 못 빠져나와요
+        if ( m_pipe.is_read_paused() )
+        {
+          m_pipe.close();
+          m_is_pipe_open = false;
+          m_mode = Mode::COPY;
+          m_streak = 0;
+
+          return pump_copy();
+        }
+
+        ssize_t r = Network::ZeroCopyTransfer::splice_data( m_from, m_pipe.write_fd(), m_pipe.size() );
+        if ( r <= 0 )
+        {
+          if ( r == 0 )
+          {
+            return RelayStatus::CLOSED;
+          }
+          return is_again() ? RelayStatus::AGAIN : RelayStatus::FAILED;
+        }
+
+        observe( static_cast<size_t>( r ) );
+        m_pipe.on_transfer( static_cast<size_t>( r ), 0 );
+      }
+    }
+
+  public:
+    FlowRelay() = default;
+    FlowRelay( const FlowRelay& ) = delete;
+    FlowRelay& operator=( const FlowRelay& ) = delete;
+
+    ~FlowRelay()
+    {
+      release_block();
+
+      // 커널이 아직 page 를 들고있으면 완료 알림이 올 때까지 소켓째로 reaper 가 들고있어요
+      // dup 된 fd 가 남아서 주인이 close 해도 FIN 이 안 나가요. 보낸 data 뒤에 FIN 을 먼저 걸어둬요
+      if ( m_zerocopy.inflight() > 0 )
+      {
+        ::shutdown( m_to, SHUT_WR );
+      }
+
+      zerocopy_reaper.park( m_to, move( m_zerocopy ) );
+    }
+
+    // performance 는 연결이 살아있는 동안 유지되는 Config 의 것을 넘겨주세요 (shared_ptr<Config> 를 연결이 들고있어요)
+    void open( int from, int to, const Performance& performance ) noexcept
+    {
+      m_from = from;
+      m_to = to;
+      m_pipe_config = &performance.pipe;
+      m_kernel_socket = &performance.kernel_socket;
+
+      if ( performance.zerocopy.enabled )
+      {
+        m_zerocopy.open( to, &FlowRelay::current_pool, performance.zerocopy.min_size );
+      }
+    }
+
+    /**
+     * from 이 readable 이거나 to 가 writable 일 때 불러요. (edge-triggered 라 EAGAIN 까지 돌려요)
+     */
+    RelayStatus pump() noexcept
+    {
+      // to 의 EPOLLERR(zerocopy 완료 알림)도 여기로 와요
+      if ( m_zerocopy.inflight() > 0 )
+      {
+        m_zerocopy.reap();
+      }
+
+      return m_mode == Mode::COPY ? pump_copy() : pump_splice();
+    }
+
+    Mode mode() const noexcept
+    {
+      return m_mode;
+    }
+
+    /**
+     * 다른 worker 로 넘겨도 되는지 (rebalance.hpp).
+     * relay_pool 은 thread_local 이라 block 을 들고있으면 안돼요. pipe 는 fd 라 buffered 가 남아있어도 같이 넘어가요.
+     */
+    bool is_migratable() const noexcept
+    {
+      return m_pending_len == 0 && m_block.empty() && m_zerocopy.inflight() == 0;
+    }
+
+    bool has_pending() const noexcept
+    {
+      return m_pending_len > 0 || m_pipe.buffered() > 0 || m_zerocopy.inflight() > 0;
+    }
+
+    uint64_t bytes() const noexcept
+    {
+      return m_bytes;
+    }
+  };
+
+} // namespace lite_passthrough_proxy
@@ -0,0 +1,420 @@
+#pragma once
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <linux/filter.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <netinet/in.h>
+#include <span>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "config.hpp"
+#include "endpoint.hpp"
+#include "lock_free.hpp"
+
+using namespace std;
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+#ifndef SO_DETACH_REUSEPORT_BPF
+#define SO_DETACH_REUSEPORT_BPF 68
+#endif
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## ReuseportSteering
+   *
+   * SO_REUSEPORT UDP 소켓 group 에 cBPF 를 붙여서 같은 client 의 datagram 이 항상 같은 worker 로 가게 해요.
+   * 그러면 worker 의 UDP session table 은 thread_local 로 lock 없이 써도 돼요.
+   *
+   * - CLIENT: client IP 로 hash % workers (IPv4: SKF_NET_OFF+12, IPv6: source 4 word XOR). port 는 안 봐요 (IP 옵션이 있으면 위치가 바뀌어서)
+   * - CPU: 패킷을 받은 CPU % workers (SKF_AD_CPU). RSS 가 client 별로 고정이고 worker i 가 CPU i 에 pinning 돼있을 때만
+   *
+   * BPF 가 돌려주는 값은 group 에 bind 된 순서의 소켓 index 라서 worker 는 0 번부터 순서대로 bind 해야 해요.
+   * program 은 group 전체에 하나라서 소켓 하나에만 attach 하면 돼요.
+   * add_group() 으로 등록한 group 은 load / reload 때마다 performance.udp_steering 과 worker 수로 다시 attach 해요.
+   * worker 를 다시 띄워서 0 번부터 bind 하는 것과 UdpSteeringFallback::configure() 는 worker 를 띄우는 쪽 몫이에요.
+   *
+   * attach 가 실패하거나 (권한/커널), reload 중에 group 순서가 잠깐 어긋나면 패킷이 다른 worker 로 갈 수 있어요.
+   * 받는 쪽은 owner() 로 확인해서 내 것이 아니면 UdpSteeringFallback 으로 owner worker 에게 넘겨요.
+   *
+   */
+  class ReuseportSteering
+  {
+  public:
+    enum class Mode : uint8_t
+    {
+      OFF,
+      CLIENT,
+      CPU,
+    };
+
+  private:
+    static constexpr uint32_t MIX = 0x045d9f3b;
+
+    static sock_filter stmt( uint16_t code, uint32_t k ) noexcept
+    {
+      return sock_filter{ code, 0, 0, k };
+    }
+
+    static sock_filter jump( uint16_t code, uint32_t k, uint8_t jt, uint8_t jf ) noexcept
+    {
+      return sock_filter{ code, jt, jf, k };
+    }
+
+    static constexpr uint32_t mix( uint32_t hash ) noexcept
+    {
+      hash ^= hash >> 16;
+      hash *= MIX;
+      hash ^= hash >> 16;
+
+      return hash;
+    }
+
+    mutex m_groups_mutex;
+    vector<int> m_groups; // reuseport group 마다 소켓 하나
+    atomic<Mode> m_mode{ Mode::OFF };
+    atomic<uint32_t> m_workers{ 1 };
+
+    ReuseportSteering()
+    {
+      ConfigManager::instance().subscribe( [this]( const Config& config ) {
+        const uint32_t workers = config.options.worker_threads > 0 ? config.options.worker_threads : max( thread::hardware_concurrency(), 1u );
+        configure( parse( config.performance.udp_steering ), workers );
+      } );
+    }
+
+  public:
+    static ReuseportSteering& instance()
+    {
+      static ReuseportSteering singleton;
+      return singleton;
+    }
+
+    /**
+     * 등록된 group 전부 다시 attach. 보통은 config listener 가 불러요
+     */
+    void configure( Mode mode, uint32_t workers ) noexcept
+    {
+      lock_guard lock( m_groups_mutex );
+
+      m_mode.store( mode, memory_order_relaxed );
+      m_workers.store( workers, memory_order_relaxed );
+
+      for ( int fd : m_groups )
+      {
+        attach( fd, mode, workers );
+      }
+    }
+
+    /**
+     * UDP listener group 마다 소켓 하나 (worker 0 의 것). 지금 설정으로 바로 attach 해요
+     */
+    bool add_group( int fd ) noexcept
+    {
+      lock_guard lock( m_groups_mutex );
+
+      try
+      {
+        m_groups.push_back( fd );
+      }
+      catch ( ... )
+      {
+        return false;
+      }
+
+      return attach( fd, m_mode.load( memory_order_relaxed ), m_workers.load( memory_order_relaxed ) );
+    }
+
+    /**
+     * fd 를 닫기 전에
+     */
+    void remove_group( int fd ) noexcept
+    {
+      lock_guard lock( m_groups_mutex );
+      m_groups.erase( remove( m_groups.begin(), m_groups.end(), fd ), m_groups.end() );
+    }
+
+    /**
+     * owner( client, workers() ) 로 BPF 와 같은 worker 를 골라요
+     */
+    uint32_t workers() const noexcept
+    {
+      return m_workers.load( memory_order_relaxed );
+    }
+
+    Mode mode() const noexcept
+    {
+      return m_mode.load( memory_order_relaxed );
+    }
+
+    static Mode parse( const string& mode ) noexcept
+    {
+      if ( mode == "client" )
+      {
+        return Mode::CLIENT;
+      }
+
+      return mode == "cpu" ? Mode::CPU : Mode::OFF;
+    }
+
+    /**
+     * ---------------
+     * BPF PROGRAM
+     *
+     */
+    static vector<sock_filter> build( Mode mode, uint32_t workers )
+    {
+      const auto net = static_cast<uint32_t>( SKF_NET_OFF );
+
+      if ( mode == Mode::CPU )
+      {
+        return {
+          stmt( BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>( SKF_AD_OFF + SKF_AD_CPU ) ),
+          stmt( BPF_ALU | BPF_MOD | BPF_K, workers ),
+          stmt( BPF_RET | BPF_A, 0 ),
+        };
+      }
+
+      // IPv6 소켓에도 v4-mapped 로 IPv4 가 들어올 수 있어서 version 을 먼저 봐요
+      return {
+        stmt( BPF_LD | BPF_B | BPF_ABS, net + 0 ),                 // 0: A = version/ihl
+        stmt( BPF_ALU | BPF_RSH | BPF_K, 4 ),                      // 1
+        jump( BPF_JMP | BPF_JEQ | BPF_K, 6, 2, 0 ),                // 2: v6 -> 5
+        stmt( BPF_LD | BPF_W | BPF_ABS, net + 12 ),                // 3: IPv4 saddr
+        jump( BPF_JMP | BPF_JA, 10, 0, 0 ),                        // 4: -> 15
+        stmt( BPF_LD | BPF_W | BPF_ABS, net + 8 ),                 // 5: IPv6 saddr[0]
+        stmt( BPF_MISC | BPF_TAX, 0 ),                             // 6
+        stmt( BPF_LD | BPF_W | BPF_ABS, net + 12 ),                // 7: saddr[1]
+        stmt( BPF_ALU | BPF_XOR | BPF_X, 0 ),                      // 8
+        stmt( BPF_MISC | BPF_TAX, 0 ),                             // 9
+        stmt( BPF_LD | BPF_W | BPF_ABS, net + 16 ),                // 10: saddr[2]
+        stmt( BPF_ALU | BPF_XOR | BPF_X, 0 ),                      // 11
+        stmt( BPF_MISC | BPF_TAX, 0 ),                             // 12
+        stmt( BPF_LD | BPF_W | BPF_ABS, net + 20 ),                // 13: saddr[3]
+        stmt( BPF_ALU | BPF_XOR | BPF_X, 0 ),                      // 14
+        stmt( BPF_MISC | BPF_TAX, 0 ),                             // 15: mix() 와 같아야 해요
+        stmt( BPF_ALU | BPF_RSH | BPF_K, 16 ),                     // 16
+        stmt( BPF_ALU | BPF_XOR | BPF_X, 0 ),                      // 17
+        stmt( BPF_ALU | BPF_MUL | BPF_K, MIX ),                    // 18
+        stmt( BPF_MISC | BPF_TAX, 0 ),                             // 19
+        stmt( BPF_ALU | BPF_RSH | BPF_K, 16 ),                     // 20
+        stmt( BPF_ALU | BPF_XOR | BPF_X, 0 ),                      // 21
+        stmt( BPF_ALU | BPF_MOD | BPF_K, workers ),                // 22
+        stmt( BPF_RET | BPF_A, 0 ),                                // 23
+      };
+    }
+
+    /**
+     * group 의 아무 소켓 하나에. workers < 2 거나 OFF 면 붙어있던 program 을 떼요.
+     */
+    static bool attach( int fd, Mode mode, uint32_t workers ) noexcept
+    {
+      if ( mode == Mode::OFF || workers < 2 )
+      {
+        int zero = 0;
+        setsockopt( fd, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF, &zero, sizeof( zero ) );
+        return true;
+      }
+
+      vector<sock_filter> program = build( mode, workers );
+
+      sock_fprog fprog{};
+      fprog.len = static_cast<unsigned short>( program.size() );
+      fprog.filter = program.data();
+
+      return setsockopt( fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof( fprog ) ) == 0;
+    }
+
+    /**
+     * ---------------
+     * USER-SPACE (BPF 와 같은 hash)
+     *
+     */
+    static uint32_t owner( const Endpoint& client, uint32_t workers ) noexcept
+    {
+      if ( workers < 2 )
+      {
+        return 0;
+      }
+
+      // 커널 패킷의 network header 는 진짜 IPv4 라서 IPv4 / v4-mapped 는 마지막 word 만
+      uint32_t hash = ntohl( client.addr[3] );
+
+      if ( !client.is_v4() && !client.is_v4_mapped() )
+      {
+        hash ^= ntohl( client.addr[0] ) ^ ntohl( client.addr[1] ) ^ ntohl( client.addr[2] );
+      }
+
+      return mix( hash ) % workers;
+    }
+  };
+
+  /**
+   * ## UdpSteeringFallback
+   *
+   * 다른 worker 로 잘못 들어온 datagram 을 owner worker 에게 넘겨요. (BPF 가 정상이면 거의 안 써요)
+   * packet_pool 은 thread_local 이라 payload 는 복사해서 넘기고, 받는 쪽이 처리한 뒤 release() 해요.
+   *
+   */
+  class UdpSteeringFallback
+  {
+  public:
+    struct Datagram
+    {
+      Endpoint client;
+      Endpoint origin; // transparent 면 원래 목적지, 아니면 family = AF_UNSPEC
+      int listener_fd;
+      uint32_t len;
+      byte data[];
+    };
+
+  private:
+    static constexpr size_t INBOX_SIZE = 4096;
+
+    struct Worker
+    {
+      MpscRing<Datagram*, INBOX_SIZE> inbox;
+      int wake_fd{ -1 };
+    };
+
+    vector<unique_ptr<Worker>> m_workers;
+
+    alignas( 64 ) atomic<uint64_t> m_forwarded{ 0 };
+    atomic<uint64_t> m_dropped{ 0 };
+
+  public:
+    static UdpSteeringFallback& instance()
+    {
+      static UdpSteeringFallback singleton;
+      return singleton;
+    }
+
+    ~UdpSteeringFallback()
+    {
+      shutdown();
+    }
+
+    bool configure( size_t workers ) noexcept
+    {
+      shutdown();
+
+      for ( size_t i = 0; i < workers; ++i )
+      {
+        auto worker = make_unique<Worker>();
+
+        worker->wake_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        if ( worker->wake_fd < 0 )
+        {
+          shutdown();
+          return false;
+        }
+
+        m_workers.push_back( move( worker ) );
+      }
+
+      return true;
+    }
+
+    void shutdown() noexcept
+    {
+      for ( auto& worker : m_workers )
+      {
+        Datagram* datagram = nullptr;
+        while ( worker->inbox.try_pop( datagram ) )
+        {
+          release( datagram );
+        }
+
+        close( worker->wake_fd );
+      }
+
+      m_workers.clear();
+    }
+
+    int wake_fd( size_t worker ) const noexcept
+    {
+      return worker < m_workers.size() ? m_workers[worker]->wake_fd : -1;
+    }
+
+    bool forward( size_t owner, int listener_fd, const Endpoint& client, const Endpoint* origin, span<const byte> payload ) noexcept
+    {
+      auto* datagram = static_cast<Datagram*>( ::operator new( sizeof( Datagram ) + payload.size(), nothrow ) );
+      if ( !datagram || owner >= m_workers.size() )
+      {
+        ::operator delete( datagram );
+        m_dropped.fetch_add( 1, memory_order_relaxed );
+        return false;
+      }
+
+      datagram->client = client;
+      datagram->origin = origin ? *origin : Endpoint{};
+      datagram->listener_fd = listener_fd;
+      datagram->len = static_cast<uint32_t>( payload.size() );
+      memcpy( datagram->data, payload.data(), payload.size() );
+
+      if ( !m_workers[owner]->inbox.try_push( datagram ) )
+      {
+        release( datagram );
+        m_dropped.fetch_add( 1, memory_order_relaxed );
+        return false;
+      }
+
+      uint64_t one = 1;
+      [[maybe_unused]] ssize_t w = write( m_workers[owner]->wake_fd, &one, sizeof( one ) );
+
+      m_forwarded.fetch_add( 1, memory_order_relaxed );
+      return true;
+    }
+
+    /**
+     * on_datagram( Datagram* ) 가 끝나면 release() 해주세요
+     */
+    template <typename OnDatagram> size_t receive( size_t worker, OnDatagram&& on_datagram ) noexcept
+    {
+      auto& self = *m_workers[worker];
+
+      uint64_t count = 0;
+      [[maybe_unused]] ssize_t r = read( self.wake_fd, &count, sizeof( count ) );
+
+      size_t received = 0;
+      Datagram* datagram = nullptr;
+
+      while ( self.inbox.try_pop( datagram ) )
+      {
+        on_datagram( datagram );
+        received++;
+      }
+
+      return received;
+    }
+
+    static void release( Datagram* datagram ) noexcept
+    {
+      ::operator delete( datagram );
+    }
+
+    uint64_t forwarded() const noexcept
+    {
+      return m_forwarded.load( memory_order_relaxed );
+    }
+
+    uint64_t dropped() const noexcept
+    {
+      return m_dropped.load( memory_order_relaxed );
+    }
+  };
+
+} // namespace lite_passthrough_proxy
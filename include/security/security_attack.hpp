@@ -6,6 +6,7 @@
 #include <chrono>
 #include <cstring>
 #include <netinet/in.h>
+#include "../endpoint.hpp"
 
 using namespace std;
 
@@ -25,18 +26,19 @@ namespace lite_passthrough_proxy
     static constexpr uint32_t LOOPBACK = 0x7F000000;    // 127.0.0.0
     static constexpr uint32_t MULTICAST = 0xE0000000;   // 224.0.0.0
 
+    static constexpr Endpoint LOOPBACK6{ { 0, 0, 0, Endpoint::to_network( 1 ) }, 0, AF_INET6 }; // ::1
+
   public:
-    static bool ip_spoof_attack( const sockaddr_storage& address, bool is_allow_private_ip = false ) noexcept
+    static bool ip_spoof_attack( const Endpoint& address, bool is_allow_private_ip = false ) noexcept
     {
       /**
        * ====
-       * IPv4
+       * IPv4 (dual-stack 소켓으로 들어온 ::ffff:a.b.c.d 도 IPv4 규칙으로 봐요)
        * ====
        */
-      if ( address.ss_family == AF_INET )
+      if ( address.is_v4() || ( address.family == AF_INET6 && address.is_v4_mapped() ) )
       {
-        auto* sin = reinterpret_cast<const sockaddr_in*>( &address );
-        uint32_t ip = ntohl( sin->sin_addr.s_addr );
+        uint32_t ip = address.ipv4();
 
         // loopback
         if ( ( ip & 0xFF000000 ) == LOOPBACK )
@@ -71,13 +73,12 @@ namespace lite_passthrough_proxy
        * ====
        *
        */
-      else if ( address.ss_family == AF_INET6 )
+      else if ( address.family == AF_INET6 )
       {
-        auto* sin6 = reinterpret_cast<const sockaddr_in6*>( &address );
+        const uint8_t* bytes = address.bytes();
 
         // loopback (::1)
-        static const uint8_t loopback[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
-        if ( memcmp( &sin6->sin6_addr, loopback, 16 ) == 0 )
+        if ( address.same_address( LOOPBACK6 ) )
         {
           return false;
         }
@@ -85,21 +86,20 @@ namespace lite_passthrough_proxy
         if ( !is_allow_private_ip )
         {
           // private address (fc00::)
-          if ( ( sin6->sin6_addr.s6_addr[0] & 0xFE ) == 0xFC )
+          if ( ( bytes[0] & 0xFE ) == 0xFC )
           {
             return false;
           }
 
           // local address (fe80::)
-          if ( sin6->sin6_addr.s6_addr[0] == 0xFE && ( sin6->sin6_addr.s6_addr[1] & 0xC0 ) == 0x80 )
+          if ( bytes[0] == 0xFE && ( bytes[1] & 0xC0 ) == 0x80 )
           {
             return false;
           }
         }
 
         // (::)
-        static const uint8_t unspecified[16] = { 0 };
-        if ( memcmp( &sin6->sin6_addr, unspecified, 16 ) == 0 )
+        if ( address.same_address( Endpoint{} ) )
         {
           return false;
         }
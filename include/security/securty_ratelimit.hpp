@@ -6,6 +6,8 @@
 #include <chrono>
 #include <cstring>
 #include <netinet/in.h>
+#include "../coarse_clock.hpp"
+#include "../endpoint.hpp"
 
 using namespace std;
 
@@ -26,33 +28,9 @@ namespace lite_passthrough_proxy
     uint64_t m_rate;  // tokens/1sec
     uint64_t m_burst; // burst size
 
-    static uint32_t address_hash( const sockaddr_storage& addr ) noexcept
+    static uint32_t bucket_of( const Endpoint& client ) noexcept
     {
-      uint32_t hash = 0;
-
-      if ( addr.ss_family == AF_INET )
-      {
-        auto* sin = reinterpret_cast<const sockaddr_in*>( &addr );
-        hash = sin->sin_addr.s_addr;
-        hash ^= sin->sin_port;
-      }
-      else if ( addr.ss_family == AF_INET6 )
-      {
-        auto* sin6 = reinterpret_cast<const sockaddr_in6*>( &addr );
-        hash = sin6->sin6_addr.s6_addr32[0];
-        hash ^= sin6->sin6_addr.s6_addr32[1];
-        hash ^= sin6->sin6_addr.s6_addr32[2];
-        hash ^= sin6->sin6_addr.s6_addr32[3];
-        hash ^= sin6->sin6_port;
-      }
-
-      hash ^= ( hash >> 16 );
-      hash *= 0x85ebca6b;
-      hash ^= ( hash >> 13 );
-      hash *= 0xc2b2ae35;
-      hash ^= ( hash >> 16 );
-
-      return hash & ( BUCKET_COUNT - 1 );
+      return client.address_hash() & ( BUCKET_COUNT - 1 );
     }
 
   public:
@@ -65,11 +43,12 @@ namespace lite_passthrough_proxy
       }
     }
 
-    bool eat( const sockaddr_storage& addr, uint64_t tokens = 1 ) noexcept
+    bool eat( const Endpoint& client, uint64_t tokens = 1 ) noexcept
     {
-      auto& bucket = m_buckets[address_hash( addr )];
+      auto& bucket = m_buckets[bucket_of( client )];
 
-      auto now_ns = chrono::steady_clock::now().time_since_epoch().count();
+      // 패킷마다 clock_gettime 하지 않고 worker loop 에서 갱신된 값 (coarse 여도 refill 은 elapsed 기준이라 토큰이 새지 않아요)
+      auto now_ns = static_cast<int64_t>( CoarseClock::now_ns() );
 
       int64_t last_refill = bucket.last_refill_ns.load( memory_order_acquire );
       if ( last_refill > 0 )
@@ -106,9 +85,9 @@ namespace lite_passthrough_proxy
       return false;
     }
 
-    uint64_t tokens( const sockaddr_storage& addr ) const noexcept
+    uint64_t tokens( const Endpoint& client ) const noexcept
     {
-      const auto& bucket = m_buckets[address_hash( addr )];
+      const auto& bucket = m_buckets[bucket_of( client )];
       return bucket.tokens.load( memory_order_relaxed );
     }
 
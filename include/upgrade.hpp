@@ -0,0 +1,422 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <span>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+#include "config.hpp"
+#include "relay.hpp"
+
+using namespace std;
+
+namespace lite_passthrough_proxy
+{
+  /**
+   * ## Upgrade (zero-downtime binary upgrade)
+   *
+   * 기존 프로세스(old)가 unix socket 으로 새 프로세스(new)에게 fd 를 SCM_RIGHTS 로 넘겨요.
+   *
+   *   new --- HELLO(version, entry_size) ---------> old   다르면 old 가 끊고 혼자 계속 서비스
+   *   new <-- FDS(entries + fds) x N -------------- old   listener 먼저, 그다음 TCP pair / UDP session
+   *   new <-- END --------------------------------- old
+   *   new     (listener 를 epoll 에 등록, accept 시작)
+   *   new --- READY ------------------------------> old
+   *   old     (listener 닫고 accept 중단, shutdown_timeout 안에 drain 후 종료)
+   *
+   * READY 전까지는 두 프로세스가 같은 listen queue 를 공유하니까 accept 공백이 없어요.
+   * 넘겨준 연결 fd 는 old 쪽에서 epoll 등록만 빼고 close 해요 (커널 소켓은 new 가 계속 들고있음).
+   *
+   * 같은 euid 의 process 끼리만 주고받아요 (SO_PEERCRED). socket 파일도 0600 이라 다른 사용자는 connect 도 못 해요.
+   * 안 그러면 local 사용자 누구나 listener 와 맺어진 client / upstream 연결을 통째로 가져가요.
+   *
+   * TCP pair 는 fd 만 넘어가서 old 의 user-space 에 남은 데이터 (splice pipe, copy pending block, zerocopy page) 는
+   * 같이 못 넘어가요. 그래서 두 방향 relay 가 비어있는 pair 만 export_pair() 로 넘기고, 나머지는 old 가 drain 해요.
+   *
+   */
+  class Upgrade
+  {
+  public:
+    enum class Kind : uint8_t
+    {
+      TCP_LISTENER = 1,
+      UDP_LISTENER = 2,
+      TCP_PAIR = 3,    // fds: client, upstream
+      UDP_SESSION = 4, // fds: upstream (client 주소는 entry 에)
+    };
+
+    struct HandoffEntry
+    {
+      Kind kind;
+      uint8_t fd_count;
+      uint16_t worker;
+      uint16_t port; // listen(src) port
+      uint16_t reserved{ 0 };
+      int64_t idle_remaining_ms{ 0 }; // idle_timeout 까지 남은 시간 (프로세스마다 steady_clock 기준점이 달라요)
+      sockaddr_storage client{};     // UDP_SESSION 전용
+    };
+
+  private:
+    enum class Message : uint8_t
+    {
+      HELLO = 1,
+      FDS = 2,
+      END = 3,
+      READY = 4,
+    };
+
+    struct Header
+    {
+      Message type;
+      uint8_t entry_count;
+      uint16_t version{ PROTOCOL_VERSION };
+      uint32_t entry_size{ sizeof( HandoffEntry ) }; // HandoffEntry 를 raw memory 로 주고받아서 빌드가 달라도 같은지 확인
+    };
+
+    static constexpr uint16_t PROTOCOL_VERSION = 2;
+    static constexpr size_t MAX_ENTRIES = 32;
+    static constexpr size_t MAX_FDS = MAX_ENTRIES * 2; // SCM_MAX_FD(253) 보다 작게
+
+    static bool send_all( int sock, const void* data, size_t len ) noexcept
+    {
+      const auto* p = static_cast<const char*>( data );
+
+      while ( len > 0 )
+      {
+        ssize_t w = send( sock, p, len, MSG_NOSIGNAL );
+        if ( w < 0 )
+        {
+          if ( errno == EINTR )
+          {
+            continue;
+          }
+          return false;
+        }
+
+        p += w;
+        len -= w;
+      }
+
+      return true;
+    }
+
+    static bool send_message( int sock, Message type ) noexcept
+    {
+      Header header{ .type = type, .entry_count = 0 };
+      return send_all( sock, &header, sizeof( header ) );
+    }
+
+    static bool send_chunk( int sock, span<const HandoffEntry> entries, span<const int> fds ) noexcept
+    {
+      Header header{ .type = Message::FDS, .entry_count = static_cast<uint8_t>( entries.size() ) };
+
+      iovec iov[2] = {
+        { .iov_base = &header, .iov_len = sizeof( header ) },
+        { .iov_base = const_cast<HandoffEntry*>( entries.data() ), .iov_len = entries.size_bytes() },
+      };
+
+      alignas( cmsghdr ) char control[CMSG_SPACE( sizeof( int ) * MAX_FDS )]{};
+
+      msghdr msg{};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = 2;
+      msg.msg_control = control;
+      msg.msg_controllen = CMSG_SPACE( fds.size_bytes() );
+
+      auto* cmsg = CMSG_FIRSTHDR( &msg );
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN( fds.size_bytes() );
+      memcpy( CMSG_DATA( cmsg ), fds.data(), fds.size_bytes() );
+
+      // SOCK_SEQPACKET 이라 메시지 경계가 보장돼요
+      return sendmsg( sock, &msg, MSG_NOSIGNAL ) == static_cast<ssize_t>( sizeof( header ) + entries.size_bytes() );
+    }
+
+    static bool wait_readable( int sock, int timeout_ms ) noexcept
+    {
+      pollfd pfd{ .fd = sock, .events = POLLIN, .revents = 0 };
+      return poll( &pfd, 1, timeout_ms ) == 1;
+    }
+
+    static bool is_compatible( const Header& header ) noexcept
+    {
+      return header.version == PROTOCOL_VERSION && header.entry_size == sizeof( HandoffEntry );
+    }
+
+    static bool is_same_user( int sock ) noexcept
+    {
+      ucred cred{};
+      socklen_t len = sizeof( cred );
+
+      return getsockopt( sock, SOL_SOCKET, SO_PEERCRED, &cred, &len ) == 0 && cred.uid == geteuid();
+    }
+
+    static void close_all( span<const int> fds ) noexcept
+    {
+      for ( int fd : fds )
+      {
+        close( fd );
+      }
+    }
+
+  public:
+    /**
+     * ---------------
+     * SOCKETS
+     *
+     */
+    static int listen( const string& path ) noexcept
+    {
+      sockaddr_un addr{};
+      if ( path.empty() || path.size() >= sizeof( addr.sun_path ) )
+      {
+        return -1;
+      }
+
+      int sock = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+      if ( sock < 0 )
+      {
+        return -1;
+      }
+
+      addr.sun_family = AF_UNIX;
+      memcpy( addr.sun_path, path.c_str(), path.size() );
+      unlink( path.c_str() );
+
+      // bind 는 socket inode 의 mode 에 umask 를 씌워서 파일을 만들어요. 처음부터 0600 (bind 뒤 chmod 는 그 사이 틈이 있어요)
+      if ( fchmod( sock, S_IRUSR | S_IWUSR ) != 0 || bind( sock, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) != 0 || ::listen( sock, 1 ) != 0 )
+      {
+        close( sock );
+        return -1;
+      }
+
+      return sock;
+    }
+
+    static int connect( const string& path ) noexcept
+    {
+      sockaddr_un addr{};
+      if ( path.empty() || path.size() >= sizeof( addr.sun_path ) )
+      {
+        return -1;
+      }
+
+      int sock = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+      if ( sock < 0 )
+      {
+        return -1;
+      }
+
+      addr.sun_family = AF_UNIX;
+      memcpy( addr.sun_path, path.c_str(), path.size() );
+
+      if ( ::connect( sock, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) != 0 || !is_same_user( sock ) || !send_message( sock, Message::HELLO ) )
+      {
+        close( sock );
+        return -1;
+      }
+
+      return sock;
+    }
+
+    /**
+     * ---------------
+     * OLD PROCESS
+     *
+     * entries[i] 는 fds 에서 fd_count 개씩 순서대로 가져가요.
+     * 실패하면 아무것도 넘어가지 않은 것으로 보고 old 가 계속 서비스하면 돼요.
+     *
+     */
+    static int accept_hello( int listen_sock, int timeout_ms ) noexcept
+    {
+      if ( !wait_readable( listen_sock, timeout_ms ) )
+      {
+        return -1;
+      }
+
+      int sock = accept4( listen_sock, nullptr, nullptr, SOCK_CLOEXEC );
+      if ( sock < 0 )
+      {
+        return -1;
+      }
+
+      if ( !is_same_user( sock ) )
+      {
+        close( sock );
+        return -1;
+      }
+
+      Header header{};
+      if ( !wait_readable( sock, timeout_ms ) || recv( sock, &header, sizeof( header ), 0 ) != sizeof( header ) || header.type != Message::HELLO || !is_compatible( header ) )
+      {
+        close( sock );
+        return -1;
+      }
+
+      return sock;
+    }
+
+    /**
+     * TCP pair 하나를 entries / fds 에 넣어요. 두 방향 relay 에 남은 데이터가 있으면 false (old 가 계속 들고 drain)
+     */
+    static bool export_pair( vector<HandoffEntry>& entries, vector<int>& fds, uint16_t worker, uint16_t port, int client_fd, int upstream_fd, const FlowRelay& to_upstream, const FlowRelay& to_client, int64_t idle_remaining_ms )
+    {
+      for ( const FlowRelay* relay : { &to_upstream, &to_client } )
+      {
+        if ( !relay->is_migratable() || relay->has_pending() )
+        {
+          return false;
+        }
+      }
+
+      entries.push_back( HandoffEntry{ .kind = Kind::TCP_PAIR, .fd_count = 2, .worker = worker, .port = port, .idle_remaining_ms = idle_remaining_ms } );
+      fds.push_back( client_fd );
+      fds.push_back( upstream_fd );
+
+      return true;
+    }
+
+    static bool send_fds( int sock, span<const HandoffEntry> entries, span<const int> fds ) noexcept
+    {
+      size_t fd_offset = 0;
+
+      for ( size_t begin = 0; begin < entries.size(); )
+      {
+        size_t end = begin, fd_count = 0;
+
+        while ( end < entries.size() && end - begin < MAX_ENTRIES && fd_count + entries[end].fd_count <= MAX_FDS )
+        {
+          fd_count += entries[end].fd_count;
+          end++;
+        }
+
+        if ( fd_offset + fd_count > fds.size() || !send_chunk( sock, entries.subspan( begin, end - begin ), fds.subspan( fd_offset, fd_count ) ) )
+        {
+          return false;
+        }
+
+        begin = end;
+        fd_offset += fd_count;
+      }
+
+      return send_message( sock, Message::END );
+    }
+
+    static bool wait_ready( int sock, int timeout_ms ) noexcept
+    {
+      Header header{};
+      return wait_readable( sock, timeout_ms ) && recv( sock, &header, sizeof( header ), 0 ) == sizeof( header ) && header.type == Message::READY && is_compatible( header );
+    }
+
+    /**
+     * old 는 READY 를 받은 시점부터 shutdown_timeout 안에 남은 연결을 정리해요.
+     */
+    static chrono::steady_clock::time_point drain_deadline( const OptionConnection& connection ) noexcept
+    {
+      return chrono::steady_clock::now() + chrono::milliseconds( connection.shutdown_timeout );
+    }
+
+    /**
+     * ---------------
+     * NEW PROCESS
+     *
+     */
+    /**
+     * false 면 이번에 받은 fd 는 전부 닫아요 (entries / fds 는 비워요). new 는 혼자 새로 listen 하면 돼요.
+     */
+    static bool receive_fds( int sock, vector<HandoffEntry>& entries, vector<int>& fds, int timeout_ms ) noexcept
+    {
+      entries.clear();
+      fds.clear();
+
+      auto fail = [&]() noexcept
+      {
+        close_all( fds );
+        entries.clear();
+        fds.clear();
+
+        return false;
+      };
+
+      while ( wait_readable( sock, timeout_ms ) )
+      {
+        Header header{};
+        array<HandoffEntry, MAX_ENTRIES> chunk{};
+
+        iovec iov[2] = {
+          { .iov_base = &header, .iov_len = sizeof( header ) },
+          { .iov_base = chunk.data(), .iov_len = sizeof( chunk ) },
+        };
+
+        alignas( cmsghdr ) char control[CMSG_SPACE( sizeof( int ) * MAX_FDS )]{};
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof( control );
+
+        ssize_t len = recvmsg( sock, &msg, MSG_CMSG_CLOEXEC );
+        if ( len < 0 )
+        {
+          return fail();
+        }
+
+        // MSG_CTRUNC 여도 들어온 만큼은 이미 우리 fd 라서 먼저 챙겨서 닫을 수 있게
+        for ( auto* cmsg = CMSG_FIRSTHDR( &msg ); cmsg; cmsg = CMSG_NXTHDR( &msg, cmsg ) )
+        {
+          if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS )
+          {
+            size_t count = ( cmsg->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+            const int* received = reinterpret_cast<const int*>( CMSG_DATA( cmsg ) );
+
+            fds.insert( fds.end(), received, received + count );
+          }
+        }
+
+        if ( len < static_cast<ssize_t>( sizeof( header ) ) || ( msg.msg_flags & ( MSG_TRUNC | MSG_CTRUNC ) ) || !is_compatible( header ) )
+        {
+          return fail();
+        }
+
+        if ( header.type == Message::END )
+        {
+          size_t expected = 0;
+          for ( const auto& entry : entries )
+          {
+            expected += entry.fd_count;
+          }
+
+          return expected == fds.size() ? true : fail();
+        }
+
+        if ( header.type != Message::FDS || len != static_cast<ssize_t>( sizeof( header ) + header.entry_count * sizeof( HandoffEntry ) ) )
+        {
+          return fail();
+        }
+
+        entries.insert( entries.end(), chunk.begin(), chunk.begin() + header.entry_count );
+      }
+
+      return fail();
+    }
+
+    /**
+     * listener 를 epoll 에 등록해서 accept 를 시작한 뒤에 불러주세요.
+     */
+    static bool send_ready( int sock ) noexcept
+    {
+      return send_message( sock, Message::READY );
+    }
+  };
+
+} // namespace lite_passthrough_proxy
@@ -0,0 +1,165 @@
+/**
+ * ## Flow journal reader
+ *
+ * FlowJournal segment 파일(<path>.<seq>) 을 읽어서 record 를 한 줄씩 출력해요.
+ *
+ * > build: g++ -std=c++20 -O2 -Iinclude tools/flow_journal_reader.cpp -o flow_journal_reader
+ * > usage: ./flow_journal_reader [--csv] /var/lib/lite-passthrough-proxy/flows.journal.1760000000 ...
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/flow_journal.hpp"
+
+using namespace std;
+using namespace lite_passthrough_proxy;
+
+namespace
+{
+  const char* close_reason( FlowCloseReason reason ) noexcept
+  {
+    switch ( reason )
+    {
+      case FlowCloseReason::CLIENT_CLOSED:
+        return "client_closed";
+      case FlowCloseReason::UPSTREAM_CLOSED:
+        return "upstream_closed";
+      case FlowCloseReason::IDLE_TIMEOUT:
+        return "idle_timeout";
+      case FlowCloseReason::CONNECT_FAILED:
+        return "connect_failed";
+      case FlowCloseReason::REJECTED:
+        return "rejected";
+      case FlowCloseReason::ERROR:
+        return "error";
+      case FlowCloseReason::SHUTDOWN:
+        return "shutdown";
+      default:
+        return "none";
+    }
+  }
+
+  string timestamp( uint64_t ns )
+  {
+    const time_t sec = static_cast<time_t>( ns / 1'000'000'000ULL );
+    tm utc{};
+    gmtime_r( &sec, &utc );
+
+    char buf[40];
+    size_t len = strftime( buf, sizeof( buf ), "%Y-%m-%dT%H:%M:%S", &utc );
+    snprintf( buf + len, sizeof( buf ) - len, ".%03lluZ", static_cast<unsigned long long>( ns / 1'000'000 % 1000 ) );
+
+    return buf;
+  }
+
+  int dump( const char* path, bool is_csv )
+  {
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+      perror( path );
+      return 1;
+    }
+
+    struct stat st{};
+    fstat( fd, &st );
+
+    if ( static_cast<size_t>( st.st_size ) < sizeof( FlowJournalHeader ) )
+    {
+      fprintf( stderr, "%s: too small\n", path );
+      close( fd );
+      return 1;
+    }
+
+    void* base = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+
+    if ( base == MAP_FAILED )
+    {
+      perror( "mmap" );
+      return 1;
+    }
+
+    FlowJournalHeader header;
+    memcpy( &header, base, sizeof( header ) );
+
+    const FlowJournalHeader expected;
+    if ( memcmp( header.magic, expected.magic, sizeof( header.magic ) ) != 0 || header.record_size != sizeof( FlowRecord ) )
+    {
+      fprintf( stderr, "%s: not a flow journal (or different version)\n", path );
+      munmap( base, st.st_size );
+      return 1;
+    }
+
+    // header_size 는 파일에서 읽은 값이라 그대로 offset 으로 쓰면 안돼요
+    if ( header.header_size < sizeof( header ) || header.header_size > static_cast<uint64_t>( st.st_size ) )
+    {
+      fprintf( stderr, "%s: corrupt header (header_size %u)\n", path, header.header_size );
+      munmap( base, st.st_size );
+      return 1;
+    }
+
+    const uint64_t available = ( st.st_size - header.header_size ) / sizeof( FlowRecord );
+    const auto* records = reinterpret_cast<const FlowRecord*>( static_cast<const char*>( base ) + header.header_size );
+
+    for ( uint64_t i = 0; i < min( header.capacity, available ); ++i )
+    {
+      const FlowRecord& r = records[i];
+      if ( r.committed != FLOW_COMMITTED )
+      {
+        continue;
+      }
+
+      const double duration = r.end_ns > r.start_ns ? ( r.end_ns - r.start_ns ) / 1e9 : 0.0;
+      const char* protocol = r.protocol == IPPROTO_UDP ? "udp" : "tcp";
+
+      if ( is_csv )
+      {
+        printf( "%s,%s,%u,%s,%s,%s,%.3f,%llu,%llu,%llu,%llu,%s\n", timestamp( r.start_ns ).c_str(), protocol, r.route_port, r.client.to_string().c_str(), r.upstream.to_string().c_str(), timestamp( r.end_ns ).c_str(), duration, static_cast<unsigned long long>( r.bytes_in ),
+          static_cast<unsigned long long>( r.bytes_out ), static_cast<unsigned long long>( r.packets_in ), static_cast<unsigned long long>( r.packets_out ), close_reason( r.close_reason ) );
+      }
+      else
+      {
+        printf( "%s %s :%u %s -> %s %.3fs in=%llu/%llu out=%llu/%llu %s\n", timestamp( r.start_ns ).c_str(), protocol, r.route_port, r.client.to_string().c_str(), r.upstream.to_string().c_str(), duration, static_cast<unsigned long long>( r.bytes_in ),
+          static_cast<unsigned long long>( r.packets_in ), static_cast<unsigned long long>( r.bytes_out ), static_cast<unsigned long long>( r.packets_out ), close_reason( r.close_reason ) );
+      }
+    }
+
+    munmap( base, st.st_size );
+    return 0;
+  }
+} // namespace
+
+int main( int argc, char** argv )
+{
+  bool is_csv = false;
+  int status = 0;
+  int files = 0;
+
+  for ( int i = 1; i < argc; ++i )
+  {
+    if ( strcmp( argv[i], "--csv" ) == 0 )
+    {
+      is_csv = true;
+      printf( "start,protocol,route_port,client,upstream,end,duration_sec,bytes_in,bytes_out,packets_in,packets_out,close_reason\n" );
+      continue;
+    }
+
+    status |= dump( argv[i], is_csv );
+    files++;
+  }
+
+  if ( files == 0 )
+  {
+    fprintf( stderr, "usage: %s [--csv] <journal-file>...\n", argv[0] );
+    return 2;
+  }
+
+  return status;
+}
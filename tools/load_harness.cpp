@@ -0,0 +1,697 @@
+/**
+ * ## Load harness
+ *
+ * loopback 하나로 프록시 앞뒤를 모두 띄워서 부하를 걸어봐요.
+ *
+ *   client(s) --> proxy(:base_port) --> echo backend(:base_port + 100)
+ *
+ * - TCP/UDP echo backend 를 이 프로세스 안에 띄우고
+ * - routes.yml 을 생성해서 프록시를 fork/exec 하고
+ * - 지정한 연결/세션 수, 메시지 크기, rate 로 ping-pong 을 돌린 뒤
+ * - throughput, p50/p99/p999 latency, CPU sec/Gbit, RSS 를 출력해요.
+ *
+ * > build: g++ -std=c++20 -O2 -pthread tools/load_harness.cpp -o load_harness
+ * > usage: ./load_harness --proxy ./lite-passthrough-proxy --mode both --connections 256 --size 1024 --duration 10
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+  using Clock = chrono::steady_clock;
+
+  struct HarnessOptions
+  {
+    string proxy_path;
+    string mode{ "both" }; // tcp | udp | both
+
+    uint16_t base_port{ 19000 };
+    uint32_t connections{ 64 }; // TCP connections
+    uint32_t sessions{ 64 };    // UDP sessions
+    uint32_t client_threads{ 4 };
+    uint32_t worker_threads{ 0 };
+
+    size_t message_size{ 512 };
+    uint32_t rate{ 0 };     // msgs/sec per connection (0 = closed loop)
+    uint32_t duration{ 10 }; // sec
+    uint32_t warmup{ 1 };    // sec
+
+    bool keep_config{ false };
+  };
+
+  struct ProcSample
+  {
+    double cpu_sec{ 0 };
+    size_t rss_kb{ 0 };
+    size_t hwm_kb{ 0 };
+  };
+
+  atomic<bool> g_running{ true };
+
+  int64_t now_ns() noexcept
+  {
+    return chrono::duration_cast<chrono::nanoseconds>( Clock::now().time_since_epoch() ).count();
+  }
+
+  bool set_nonblock( int fd ) noexcept
+  {
+    int flags = fcntl( fd, F_GETFL, 0 );
+    return flags >= 0 && fcntl( fd, F_SETFL, flags | O_NONBLOCK ) == 0;
+  }
+
+  sockaddr_in loopback( uint16_t port ) noexcept
+  {
+    sockaddr_in addr{};
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    return addr;
+  }
+
+  /**
+   * ---------------
+   * /proc sampling
+   *
+   */
+  ProcSample sample_process( pid_t pid )
+  {
+    ProcSample sample;
+
+    ifstream stat( "/proc/" + to_string( pid ) + "/stat" );
+    string line;
+    if ( getline( stat, line ) )
+    {
+      // comm 안에 공백이 있을 수 있으니 마지막 ')' 뒤부터 파싱
+      auto pos = line.rfind( ')' );
+      if ( pos != string::npos )
+      {
+        istringstream iss( line.substr( pos + 2 ) );
+        vector<string> fields;
+        string field;
+
+        while ( iss >> field )
+        {
+          fields.push_back( field );
+        }
+
+        // state(0) ... utime(11) stime(12)
+        if ( fields.size() > 12 )
+        {
+          double ticks = static_cast<double>( sysconf( _SC_CLK_TCK ) );
+          sample.cpu_sec = ( stoull( fields[11] ) + stoull( fields[12] ) ) / ticks;
+        }
+      }
+    }
+
+    ifstream status( "/proc/" + to_string( pid ) + "/status" );
+    while ( getline( status, line ) )
+    {
+      if ( line.rfind( "VmRSS:", 0 ) == 0 )
+      {
+        sample.rss_kb = stoull( line.substr( 6 ) );
+      }
+      else if ( line.rfind( "VmHWM:", 0 ) == 0 )
+      {
+        sample.hwm_kb = stoull( line.substr( 6 ) );
+      }
+    }
+
+    return sample;
+  }
+
+  /**
+   * ---------------
+   * Echo backends
+   *
+   */
+  void tcp_echo_backend( int listen_fd )
+  {
+    int epfd = epoll_create1( EPOLL_CLOEXEC );
+    epoll_event ev{ .events = EPOLLIN, .data = { .fd = listen_fd } };
+    epoll_ctl( epfd, EPOLL_CTL_ADD, listen_fd, &ev );
+
+    vector<epoll_event> events( 256 );
+    vector<char> buffer( 65536 );
+
+    while ( g_running.load( memory_order_relaxed ) )
+    {
+      int n = epoll_wait( epfd, events.data(), static_cast<int>( events.size() ), 100 );
+
+      for ( int i = 0; i < n; ++i )
+      {
+        int fd = events[i].data.fd;
+
+        if ( fd == listen_fd )
+        {
+          int client;
+          while ( ( client = accept4( listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC ) ) >= 0 )
+          {
+            int one = 1;
+            setsockopt( client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+
+            epoll_event cev{ .events = EPOLLIN | EPOLLRDHUP, .data = { .fd = client } };
+            epoll_ctl( epfd, EPOLL_CTL_ADD, client, &cev );
+          }
+          continue;
+        }
+
+        ssize_t len = recv( fd, buffer.data(), buffer.size(), 0 );
+        if ( len <= 0 )
+        {
+          if ( len == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) )
+          {
+            close( fd );
+          }
+          continue;
+        }
+
+        // 작은 메시지 기준이라 blocking 에 가깝게 끝까지 돌려줘요
+        ssize_t sent = 0;
+        while ( sent < len )
+        {
+          ssize_t w = send( fd, buffer.data() + sent, len - sent, MSG_NOSIGNAL );
+          if ( w < 0 )
+          {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK )
+            {
+              this_thread::yield();
+              continue;
+            }
+            close( fd );
+            break;
+          }
+          sent += w;
+        }
+      }
+    }
+
+    close( epfd );
+  }
+
+  void udp_echo_backend( int fd )
+  {
+    vector<char> buffer( 65536 );
+
+    while ( g_running.load( memory_order_relaxed ) )
+    {
+      sockaddr_storage peer{};
+      socklen_t peer_len = sizeof( peer );
+
+      ssize_t len = recvfrom( fd, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>( &peer ), &peer_len );
+      if ( len > 0 )
+      {
+        sendto( fd, buffer.data(), len, 0, reinterpret_cast<sockaddr*>( &peer ), peer_len );
+      }
+    }
+  }
+
+  int open_backend( int type, uint16_t port )
+  {
+    int fd = socket( AF_INET, type | SOCK_CLOEXEC, 0 );
+    int one = 1;
+    setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+
+    auto addr = loopback( port );
+    if ( bind( fd, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) != 0 )
+    {
+      perror( "bind backend" );
+      exit( 1 );
+    }
+
+    if ( type == SOCK_STREAM )
+    {
+      listen( fd, 4096 );
+      set_nonblock( fd );
+    }
+    else
+    {
+      timeval tv{ .tv_sec = 0, .tv_usec = 100000 };
+      setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+    }
+
+    return fd;
+  }
+
+  /**
+   * ---------------
+   * routes.yml
+   *
+   */
+  filesystem::path write_config( const HarnessOptions& opts, uint16_t tcp_port, uint16_t udp_port, uint16_t tcp_backend, uint16_t udp_backend )
+  {
+    auto dir = filesystem::temp_directory_path() / ( "lpp-harness-" + to_string( getpid() ) );
+    filesystem::create_directories( dir );
+
+    auto path = dir / "routes.yml";
+    ofstream out( path );
+
+    out << "routes:\n";
+    out << "  - port: " << tcp_port << "\n";
+    out << "    protocol: \"tcp\"\n";
+    out << "    dest_host: \"127.0.0.1\"\n";
+    out << "    dest_port: " << tcp_backend << "\n";
+    out << "  - port: " << udp_port << "\n";
+    out << "    protocol: \"udp\"\n";
+    out << "    dest_host: \"127.0.0.1\"\n";
+    out << "    dest_port: " << udp_backend << "\n";
+    out << "\n";
+    out << "options:\n";
+    out << "  worker_threads: " << opts.worker_threads << "\n";
+    out << "  log_level: \"error\"\n";
+    out << "\n";
+    out << "security:\n";
+    out << "  tcp:\n";
+    out << "    connection_limits: " << max<uint32_t>( opts.connections * 2, 1024 ) << "\n";
+    out << "    connection_ip_limits: " << max<uint32_t>( opts.connections * 2, 1024 ) << "\n";
+    out << "  udp:\n";
+    out << "    connection_limits: " << max<uint32_t>( opts.sessions * 2, 1024 ) << "\n";
+    out << "    pps_ip_limits: 100000000\n";
+    out << "    bps_ip_limits: 4294967295\n";
+
+    return path;
+  }
+
+  pid_t start_proxy( const HarnessOptions& opts, const filesystem::path& config )
+  {
+    pid_t pid = fork();
+
+    if ( pid == 0 )
+    {
+      execl( opts.proxy_path.c_str(), opts.proxy_path.c_str(), config.c_str(), static_cast<char*>( nullptr ) );
+      perror( "execl proxy" );
+      _exit( 127 );
+    }
+
+    return pid;
+  }
+
+  bool wait_for_port( uint16_t port, chrono::milliseconds timeout )
+  {
+    auto deadline = Clock::now() + timeout;
+
+    while ( Clock::now() < deadline )
+    {
+      int fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+      auto addr = loopback( port );
+
+      if ( connect( fd, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) == 0 )
+      {
+        close( fd );
+        return true;
+      }
+
+      close( fd );
+      this_thread::sleep_for( chrono::milliseconds( 50 ) );
+    }
+
+    return false;
+  }
+
+  /**
+   * ---------------
+   * Load clients
+   *
+   * 연결마다 [send_ns(8 bytes) | padding] 메시지를 보내고 전부 돌아오면 RTT 를 기록해요.
+   * rate == 0 이면 closed-loop, 아니면 연결별 interval 로 pacing.
+   *
+   */
+  struct Flow
+  {
+    int fd{ -1 };
+    bool is_udp{ false };
+
+    size_t received{ 0 };
+    int64_t sent_ns{ 0 };
+    int64_t next_send_ns{ 0 };
+    bool in_flight{ false };
+  };
+
+  struct ClientStats
+  {
+    vector<int64_t> latencies_ns;
+    uint64_t bytes{ 0 };
+    uint64_t messages{ 0 };
+    uint64_t timeouts{ 0 };
+    uint64_t errors{ 0 };
+  };
+
+  void client_loop( const HarnessOptions& opts, vector<Flow>& flows, ClientStats& stats, int64_t measure_from_ns )
+  {
+    int epfd = epoll_create1( EPOLL_CLOEXEC );
+
+    for ( size_t i = 0; i < flows.size(); ++i )
+    {
+      epoll_event ev{ .events = EPOLLIN, .data = { .u64 = i } };
+      epoll_ctl( epfd, EPOLL_CTL_ADD, flows[i].fd, &ev );
+    }
+
+    vector<char> out( opts.message_size, 'x' );
+    vector<char> in( max<size_t>( opts.message_size, 65536 ) );
+    vector<epoll_event> events( 256 );
+
+    const int64_t interval_ns = opts.rate ? 1'000'000'000LL / opts.rate : 0;
+    const int64_t udp_timeout_ns = 1'000'000'000LL;
+
+    auto send_message = [&]( Flow& flow, int64_t ts ) {
+      memcpy( out.data(), &ts, sizeof( ts ) );
+
+      ssize_t w = send( flow.fd, out.data(), out.size(), MSG_NOSIGNAL );
+      if ( w != static_cast<ssize_t>( out.size() ) )
+      {
+        stats.errors++;
+        return;
+      }
+
+      flow.sent_ns = ts;
+      flow.received = 0;
+      flow.in_flight = true;
+    };
+
+    while ( g_running.load( memory_order_relaxed ) )
+    {
+      int64_t ts = now_ns();
+
+      for ( auto& flow : flows )
+      {
+        if ( flow.in_flight )
+        {
+          if ( flow.is_udp && ts - flow.sent_ns > udp_timeout_ns )
+          {
+            stats.timeouts++;
+            flow.in_flight = false;
+          }
+          continue;
+        }
+
+        if ( ts >= flow.next_send_ns )
+        {
+          send_message( flow, ts );
+          flow.next_send_ns = interval_ns ? max( flow.next_send_ns + interval_ns, ts ) : 0;
+        }
+      }
+
+      int n = epoll_wait( epfd, events.data(), static_cast<int>( events.size() ), 1 );
+
+      for ( int i = 0; i < n; ++i )
+      {
+        auto& flow = flows[events[i].data.u64];
+
+        while ( true )
+        {
+          ssize_t len = recv( flow.fd, in.data(), in.size(), MSG_DONTWAIT );
+          if ( len <= 0 )
+          {
+            if ( len == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) )
+            {
+              stats.errors++;
+              epoll_ctl( epfd, EPOLL_CTL_DEL, flow.fd, nullptr );
+            }
+            break;
+          }
+
+          // timeout 뒤에 늦게 온 UDP echo 는 지금 메시지 것이 아니에요 (payload 앞의 send 시각으로 구분)
+          if ( flow.is_udp )
+          {
+            int64_t echoed_ns = -1;
+            if ( static_cast<size_t>( len ) >= sizeof( echoed_ns ) )
+            {
+              memcpy( &echoed_ns, in.data(), sizeof( echoed_ns ) );
+            }
+
+            if ( !flow.in_flight || echoed_ns != flow.sent_ns )
+            {
+              continue;
+            }
+          }
+
+          flow.received += len;
+          if ( flow.in_flight && flow.received >= opts.message_size )
+          {
+            int64_t done = now_ns();
+
+            if ( flow.sent_ns >= measure_from_ns )
+            {
+              stats.latencies_ns.push_back( done - flow.sent_ns );
+              stats.bytes += opts.message_size * 2; // client->upstream + upstream->client
+              stats.messages++;
+            }
+
+            flow.in_flight = false;
+            flow.received = 0;
+          }
+        }
+      }
+    }
+
+    close( epfd );
+  }
+
+  int open_client( bool is_udp, uint16_t port )
+  {
+    int fd = socket( AF_INET, ( is_udp ? SOCK_DGRAM : SOCK_STREAM ) | SOCK_CLOEXEC, 0 );
+    auto addr = loopback( port );
+
+    if ( connect( fd, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) != 0 )
+    {
+      close( fd );
+      return -1;
+    }
+
+    if ( !is_udp )
+    {
+      int one = 1;
+      setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+    }
+
+    set_nonblock( fd );
+    return fd;
+  }
+
+  int64_t percentile( const vector<int64_t>& sorted, double p ) noexcept
+  {
+    if ( sorted.empty() )
+    {
+      return 0;
+    }
+
+    size_t idx = static_cast<size_t>( p * ( sorted.size() - 1 ) );
+    return sorted[idx];
+  }
+
+  void usage( const char* argv0 )
+  {
+    fprintf( stderr,
+      "usage: %s --proxy PATH [--mode tcp|udp|both] [--connections N] [--sessions N]\n"
+      "          [--size BYTES] [--rate MSG_PER_SEC] [--duration SEC] [--warmup SEC]\n"
+      "          [--threads N] [--workers N] [--base-port PORT] [--keep-config]\n",
+      argv0 );
+  }
+
+  bool parse_args( int argc, char** argv, HarnessOptions& opts )
+  {
+    for ( int i = 1; i < argc; ++i )
+    {
+      string arg = argv[i];
+      auto next = [&]() -> const char* { return ( i + 1 < argc ) ? argv[++i] : nullptr; };
+
+      const char* v = nullptr;
+      if ( arg == "--keep-config" )
+      {
+        opts.keep_config = true;
+        continue;
+      }
+
+      if ( ( v = next() ) == nullptr )
+      {
+        return false;
+      }
+
+      if ( arg == "--proxy" ) opts.proxy_path = v;
+      else if ( arg == "--mode" ) opts.mode = v;
+      else if ( arg == "--connections" ) opts.connections = stoul( v );
+      else if ( arg == "--sessions" ) opts.sessions = stoul( v );
+      else if ( arg == "--size" ) opts.message_size = max<size_t>( stoul( v ), sizeof( int64_t ) );
+      else if ( arg == "--rate" ) opts.rate = stoul( v );
+      else if ( arg == "--duration" ) opts.duration = stoul( v );
+      else if ( arg == "--warmup" ) opts.warmup = stoul( v );
+      else if ( arg == "--threads" ) opts.client_threads = max<uint32_t>( stoul( v ), 1 );
+      else if ( arg == "--workers" ) opts.worker_threads = stoul( v );
+      else if ( arg == "--base-port" ) opts.base_port = static_cast<uint16_t>( stoul( v ) );
+      else return false;
+    }
+
+    return !opts.proxy_path.empty() && ( opts.mode == "tcp" || opts.mode == "udp" || opts.mode == "both" );
+  }
+} // namespace
+
+int main( int argc, char** argv )
+{
+  HarnessOptions opts;
+  if ( !parse_args( argc, argv, opts ) )
+  {
+    usage( argv[0] );
+    return 2;
+  }
+
+  signal( SIGPIPE, SIG_IGN );
+
+  const bool use_tcp = opts.mode != "udp";
+  const bool use_udp = opts.mode != "tcp";
+  const uint16_t tcp_port = opts.base_port;
+  const uint16_t udp_port = opts.base_port + 1;
+  const uint16_t tcp_backend = opts.base_port + 100;
+  const uint16_t udp_backend = opts.base_port + 101;
+
+  // ## BACKENDS
+  int tcp_listen = open_backend( SOCK_STREAM, tcp_backend );
+  int udp_listen = open_backend( SOCK_DGRAM, udp_backend );
+
+  thread tcp_backend_thread( tcp_echo_backend, tcp_listen );
+  thread udp_backend_thread( udp_echo_backend, udp_listen );
+
+  // ## PROXY
+  auto config = write_config( opts, tcp_port, udp_port, tcp_backend, udp_backend );
+  pid_t proxy = start_proxy( opts, config );
+
+  if ( !wait_for_port( tcp_port, chrono::seconds( 10 ) ) )
+  {
+    fprintf( stderr, "proxy did not start listening on :%u\n", tcp_port );
+    kill( proxy, SIGTERM );
+    waitpid( proxy, nullptr, 0 );
+    g_running = false;
+    tcp_backend_thread.join();
+    udp_backend_thread.join();
+    close( tcp_listen );
+    close( udp_listen );
+
+    if ( !opts.keep_config )
+    {
+      filesystem::remove_all( config.parent_path() );
+    }
+    return 1;
+  }
+
+  // ## CLIENTS
+  vector<vector<Flow>> flows( opts.client_threads );
+  size_t opened = 0, failed = 0;
+
+  auto assign = [&]( bool is_udp, uint32_t count, uint16_t port ) {
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+      int fd = open_client( is_udp, port );
+      if ( fd < 0 )
+      {
+        failed++;
+        continue;
+      }
+
+      flows[opened++ % opts.client_threads].push_back( Flow{ .fd = fd, .is_udp = is_udp } );
+    }
+  };
+
+  if ( use_tcp )
+  {
+    assign( false, opts.connections, tcp_port );
+  }
+
+  if ( use_udp )
+  {
+    assign( true, opts.sessions, udp_port );
+  }
+
+  vector<ClientStats> stats( opts.client_threads );
+  vector<thread> clients;
+
+  const int64_t measure_from = now_ns() + static_cast<int64_t>( opts.warmup ) * 1'000'000'000LL;
+
+  for ( uint32_t i = 0; i < opts.client_threads; ++i )
+  {
+    clients.emplace_back( client_loop, cref( opts ), ref( flows[i] ), ref( stats[i] ), measure_from );
+  }
+
+  this_thread::sleep_for( chrono::seconds( opts.warmup ) );
+  auto before = sample_process( proxy );
+  auto started = Clock::now();
+
+  this_thread::sleep_for( chrono::seconds( opts.duration ) );
+
+  auto after = sample_process( proxy );
+  double elapsed = chrono::duration<double>( Clock::now() - started ).count();
+
+  g_running = false;
+  for ( auto& t : clients )
+  {
+    t.join();
+  }
+  tcp_backend_thread.join();
+  udp_backend_thread.join();
+
+  kill( proxy, SIGTERM );
+  waitpid( proxy, nullptr, 0 );
+
+  // ## REPORT
+  vector<int64_t> latencies;
+  uint64_t bytes = 0, messages = 0, timeouts = 0, errors = 0;
+
+  for ( auto& s : stats )
+  {
+    latencies.insert( latencies.end(), s.latencies_ns.begin(), s.latencies_ns.end() );
+    bytes += s.bytes;
+    messages += s.messages;
+    timeouts += s.timeouts;
+    errors += s.errors;
+  }
+
+  sort( latencies.begin(), latencies.end() );
+
+  const double gbits = bytes * 8.0 / 1e9;
+  const double cpu = after.cpu_sec - before.cpu_sec;
+
+  printf( "mode=%s flows=%zu (failed=%zu) size=%zu rate=%u duration=%.2fs\n", opts.mode.c_str(), opened, failed, opts.message_size, opts.rate, elapsed );
+  printf( "messages      %lu (%.0f msg/s), timeouts=%lu errors=%lu\n", messages, messages / elapsed, timeouts, errors );
+  printf( "throughput    %.3f Gbit/s\n", gbits / elapsed );
+  printf( "latency       p50=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n", percentile( latencies, 0.50 ) / 1e3, percentile( latencies, 0.99 ) / 1e3, percentile( latencies, 0.999 ) / 1e3, latencies.empty() ? 0.0 : latencies.back() / 1e3 );
+  printf( "proxy cpu     %.3f sec (%.1f%% of one core), %.3f cpu-sec/Gbit\n", cpu, cpu / elapsed * 100.0, gbits > 0 ? cpu / gbits : 0.0 );
+  printf( "proxy rss     %zu KiB (peak %zu KiB)\n", after.rss_kb, after.hwm_kb );
+
+  for ( auto& list : flows )
+  {
+    for ( auto& flow : list )
+    {
+      close( flow.fd );
+    }
+  }
+  close( tcp_listen );
+  close( udp_listen );
+
+  if ( !opts.keep_config )
+  {
+    filesystem::remove_all( config.parent_path() );
+  }
+
+  return 0;
+}